@@ -0,0 +1,292 @@
+//
+// cycles.c
+//
+// Copyright (c) 2000, Sam Roberts
+// 
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 1, or (at your option)
+//  any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+//  I can be contacted as sroberts@uniserve.com.
+//
+
+#include <time.h>
+
+#ifdef __QNXNTO__
+#include <inttypes.h>
+#include <sys/neutrino.h>
+#include <sys/syspage.h>
+#endif
+
+#if defined(__QNX__) && !defined(__QNXNTO__)
+#	define __QNX4__
+#	include "rdtsc64.h"
+#endif
+
+#include "cycles.h"
+
+/*
+* CPUID and the TSC
+*
+* CPUID is only available if the ID bit of EFLAGS can be toggled,
+* and the TSC is only available if CPUID says so (see the Intel
+* Architecture Software Developer's Manual, Vol 2, CPUID).
+*/
+
+#if defined(__QNX4__)
+
+/* has_cpuid(), cpuid_eax() and cpuid_edx() are #pragma aux'ed in rdtsc64.h */
+
+#define cpuid_max(LEAF)	cpuid_eax(LEAF)
+
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+static int has_cpuid(void)
+{
+#ifdef __x86_64__
+	return 1;
+#else
+	unsigned long a, c;
+
+	__asm__ __volatile__(
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"movl %0, %1\n\t"
+		"xorl $0x200000, %0\n\t"
+		"pushl %0\n\t"
+		"popfl\n\t"
+		"pushfl\n\t"
+		"popl %0\n\t"
+		"pushl %1\n\t"
+		"popfl"
+		: "=&r" (a), "=&r" (c));
+
+	return ((a ^ c) >> 21) & 1;
+#endif
+}
+static void cpuid(unsigned leaf, unsigned r[4])
+{
+	__asm__ __volatile__("cpuid"
+		: "=a" (r[0]), "=b" (r[1]), "=c" (r[2]), "=d" (r[3])
+		: "a" (leaf), "c" (0));
+}
+static unsigned cpuid_edx(unsigned leaf)
+{
+	unsigned r[4];
+	cpuid(leaf, r);
+	return r[3];
+}
+static unsigned cpuid_max(unsigned leaf)
+{
+	unsigned r[4];
+	cpuid(leaf, r);
+	return r[0];
+}
+
+#else
+
+static int has_cpuid(void) { return 0; }
+static unsigned cpuid_edx(unsigned leaf) { return 0; }
+static unsigned cpuid_max(unsigned leaf) { return 0; }
+
+#endif
+
+#define CPUID_1_EDX_TSC				(1 << 4)
+#define CPUID_1_EDX_SSE2			(1 << 26)
+#define CPUID_80000001_EDX_RDTSCP	(1 << 27)
+#define CPUID_80000007_EDX_INVTSC	(1 << 8)
+
+/*
+* Backends
+*/
+
+#if defined(__QNX4__)
+
+static unsigned read_rdtsc(unsigned* high)
+{
+	long64 l64;
+	rdtsc64(&l64);
+	*high = l64.hi;
+	return l64.lo;
+}
+#define read_rdtscp	0
+
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+
+static unsigned read_rdtsc(unsigned* high)
+{
+	unsigned low;
+	__asm__ __volatile__(".byte 0x0f,0x31" : "=a" (low), "=d" (*high));
+	return low;
+}
+static unsigned read_rdtscp(unsigned* high)
+{
+	unsigned low;
+	unsigned aux;
+	__asm__ __volatile__(".byte 0x0f,0x01,0xf9"
+		: "=a" (low), "=d" (*high), "=c" (aux));
+	return low;
+}
+
+#else
+
+#define read_rdtsc	0
+#define read_rdtscp	0
+
+#endif
+
+#ifdef __QNXNTO__
+static unsigned read_clockcycles(unsigned* high)
+{
+	uint64_t c = ClockCycles();
+	*high = (unsigned) (c >> 32);
+	return (unsigned) c;
+}
+#else
+#define read_clockcycles	0
+#endif
+
+#if defined(CLOCK_MONOTONIC_RAW)
+#	define CYCLES_CLOCK_MONOTONIC	CLOCK_MONOTONIC_RAW
+#elif defined(CLOCK_MONOTONIC)
+#	define CYCLES_CLOCK_MONOTONIC	CLOCK_MONOTONIC
+#endif
+
+#ifdef CYCLES_CLOCK_MONOTONIC
+static unsigned read_monotonic(unsigned* high)
+{
+	struct timespec ts;
+	clock_gettime(CYCLES_CLOCK_MONOTONIC, &ts);
+	*high = ts.tv_sec;
+	return ts.tv_nsec;
+}
+#else
+#define read_monotonic	0
+#endif
+
+/* This is what random.c used to call jiffies. */
+static unsigned read_realtime(unsigned* high)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	*high = ts.tv_sec;
+	return ts.tv_nsec;
+}
+
+struct cycle_source cycle_sources[CYCLES_MAX] =
+	{
+		{ "rdtscp",			0, 0, 0, read_rdtscp },
+		{ "rdtsc",			0, 0, 0, read_rdtsc },
+		{ "ClockCycles",	0, 0, 0, read_clockcycles },
+		{ "monotonic",		0, 0, 0, read_monotonic },
+		{ "realtime",		1, 0, 0, read_realtime },
+	};
+
+struct cycle_source* cycle_source = &cycle_sources[CYCLES_REALTIME];
+
+int cpu_has_sse2;
+
+/*
+* Time a backend, in nanoseconds per call.
+*/
+
+#define CYCLES_BENCHMARK_CALLS	10000
+
+static unsigned cycles_cost(struct cycle_source* s)
+{
+	struct timespec	start;
+	struct timespec	end;
+	unsigned		high;
+	long			ns;
+	int				i;
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	for(i = 0; i < CYCLES_BENCHMARK_CALLS; i++)
+		s->read(&high);
+	clock_gettime(CLOCK_REALTIME, &end);
+
+	ns = (end.tv_sec - start.tv_sec) * 1000000000L
+		+ (end.tv_nsec - start.tv_nsec);
+
+	return ns > 0 ? ns / CYCLES_BENCHMARK_CALLS : 0;
+}
+
+/*
+* Probe for each backend, and select the first available in order of
+* preference, which is the order of cycle_sources[]. The other CPU
+* features are probed here too, while CPUID is at hand. The TSC is
+* preferred even when it isn't invariant, for entropy its resolution
+* matters more than its rate.
+*/
+void cycles_init(void)
+{
+	struct cycle_source* s = 0;
+	int i;
+
+	if(has_cpuid() && cpuid_max(0) >= 1)
+		cpu_has_sse2 = !!(cpuid_edx(1) & CPUID_1_EDX_SSE2);
+
+	if(has_cpuid() && cycle_sources[CYCLES_RDTSC].read) {
+		unsigned ext = cpuid_max(0x80000000);
+
+		if(cpuid_max(0) >= 1 && (cpuid_edx(1) & CPUID_1_EDX_TSC)) {
+			int invariant = 0;
+
+			if(ext >= 0x80000007)
+				invariant = !!(cpuid_edx(0x80000007) & CPUID_80000007_EDX_INVTSC);
+
+			cycle_sources[CYCLES_RDTSC].available = 1;
+			cycle_sources[CYCLES_RDTSC].invariant = invariant;
+
+			if(cycle_sources[CYCLES_RDTSCP].read && ext >= 0x80000001 &&
+					(cpuid_edx(0x80000001) & CPUID_80000001_EDX_RDTSCP)) {
+				cycle_sources[CYCLES_RDTSCP].available = 1;
+				cycle_sources[CYCLES_RDTSCP].invariant = invariant;
+			}
+		}
+	}
+
+	if(cycle_sources[CYCLES_CLOCKCYCLES].read) {
+		cycle_sources[CYCLES_CLOCKCYCLES].available = 1;
+	}
+
+	if(cycle_sources[CYCLES_MONOTONIC].read) {
+		struct timespec ts;
+		if(clock_gettime(CYCLES_CLOCK_MONOTONIC, &ts) == 0) {
+			cycle_sources[CYCLES_MONOTONIC].available = 1;
+			cycle_sources[CYCLES_MONOTONIC].invariant = 1;
+		}
+	}
+
+	for(i = 0; i < CYCLES_MAX && !s; i++) {
+		if(cycle_sources[i].available)
+			s = &cycle_sources[i];
+	}
+
+	cycle_source = s;
+}
+
+/*
+* Time the available backends. This is kept out of cycles_init(), it
+* takes a few milliseconds, and startup should be quick.
+*/
+void cycles_benchmark(void)
+{
+	int i;
+
+	for(i = 0; i < CYCLES_MAX; i++) {
+		if(cycle_sources[i].available)
+			cycle_sources[i].cost = cycles_cost(&cycle_sources[i]);
+	}
+}
+
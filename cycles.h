@@ -0,0 +1,61 @@
+//
+// cycles.h
+//
+// Copyright (c) 2000, Sam Roberts
+// 
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 1, or (at your option)
+//  any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+//  I can be contacted as sroberts@uniserve.com.
+//
+
+#ifndef CYCLES_H
+#define CYCLES_H
+
+/*
+* A high resolution cycle counter, the best available one is selected
+* at startup by cycles_init().
+*/
+
+#define CYCLES_RDTSCP		0	/* rdtscp, serializing tsc read */
+#define CYCLES_RDTSC		1	/* rdtsc */
+#define CYCLES_CLOCKCYCLES	2	/* Nto's ClockCycles() */
+#define CYCLES_MONOTONIC	3	/* clock_gettime(CLOCK_MONOTONIC[_RAW]) */
+#define CYCLES_REALTIME		4	/* clock_gettime(CLOCK_REALTIME) */
+#define CYCLES_MAX			5
+
+struct cycle_source
+{
+	const char*	name;
+	int			available;
+	int			invariant;	/* constant rate across P- and C-states */
+	unsigned	cost;		/* nanoseconds per call, see cycles_benchmark() */
+
+	/* returns the low 32 bits of the count, the high 32 in *high */
+	unsigned	(*read)(unsigned* high);
+};
+
+extern struct cycle_source	cycle_sources[CYCLES_MAX];
+extern struct cycle_source*	cycle_source;
+
+/* other CPU features, probed by cycles_init() along with the TSC */
+extern int cpu_has_sse2;
+
+void cycles_init(void);
+void cycles_benchmark(void);
+
+#define cycles_read(HIGH)	(cycle_source->read(HIGH))
+
+#endif
+
@@ -0,0 +1,50 @@
+/**
+* devctl() commands for /dev/random and /dev/urandom, the equivalents
+* of Linux's random ioctls. GETENTCNT returns, and ADDTOENTCNT takes, a
+* count of bits as an int. Only root may change the count or clear the
+* pool.
+*/
+
+#ifndef DCMD_RANDOM_H
+#define DCMD_RANDOM_H
+
+#include <devctl.h>
+
+#include "random.h"
+
+#define DCMD_RANDOM_GETENTCNT	__DIOF(_DCMD_MISC, 0x52, int)
+#define DCMD_RANDOM_ADDTOENTCNT	__DIOT(_DCMD_MISC, 0x53, int)
+#define DCMD_RANDOM_ZAPENTCNT	__DION(_DCMD_MISC, 0x54)
+#define DCMD_RANDOM_CLEARPOOL	__DION(_DCMD_MISC, 0x55)
+
+/*
+* TCP initial sequence numbers for a batch of connections: the data
+* is an array of struct tcp_endpoints (see random.h), and is replaced
+* by an array of as many unsigned sequence numbers. Only root may ask,
+* since anyone who can learn the ISN of a connection can spoof it.
+*/
+
+#define DCMD_RANDOM_TCPSEQ		__DIOTF(_DCMD_MISC, 0x56, struct tcp_endpoints)
+
+/*
+* SYN cookies for a batch of connections: the data is an array of
+* struct tcp_syn_cookie (see random.h), returned with the cookies
+* minted, or with the data of the cookies checked. Cookies are good for
+* up to DCMD_RANDOM_SYNMAXDIFF minutes. Only root may mint or check
+* them, as a cookie accepts a connection from whoever presents it.
+*/
+
+#define DCMD_RANDOM_SYNCOOKIE	__DIOTF(_DCMD_MISC, 0x57, struct tcp_syn_cookie)
+#define DCMD_RANDOM_SYNCHECK	__DIOTF(_DCMD_MISC, 0x58, struct tcp_syn_cookie)
+
+#define DCMD_RANDOM_SYNMAXDIFF	4
+
+/*
+* How often, and how long, the -f generator's reseeds have taken, as a
+* struct rand_reseed_stats (see random.h).
+*/
+
+#define DCMD_RANDOM_RESEEDSTATS	__DIOF(_DCMD_MISC, 0x59, struct rand_reseed_stats)
+
+#endif
+
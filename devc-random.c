@@ -9,6 +9,9 @@ struct Device;
 #include <sys/iofunc.h>
 
 #include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
 #include <stdio.h>
 #include <stddef.h>
 #include <stdlib.h>
@@ -20,13 +23,20 @@ struct Device;
 #include <sys/rsrcdbmgr.h>
 
 #include "util.h"
+#include "cycles.h"
+#include "dcmd_random.h"
+#include "pool.h"
 #include "random.h"
+#include "seed.h"
 
 int IoRead	(resmgr_context_t*	ctp, io_read_t* msg, RESMGR_OCB_T* ocb);
+int IoWrite	(resmgr_context_t*	ctp, io_write_t* msg, RESMGR_OCB_T* ocb);
 int IoNotify(resmgr_context_t*	ctp, io_notify_t* msg, RESMGR_OCB_T* ocb);
+int IoDevctl(resmgr_context_t*	ctp, io_devctl_t* msg, RESMGR_OCB_T* ocb);
 int IoStat	(resmgr_context_t*	ctp, io_stat_t* msg, RESMGR_OCB_T* ocb);
 int IoLseek	(resmgr_context_t*	ctp, io_lseek_t* msg, RESMGR_OCB_T* ocb);
 int IoPulse	(message_context_t*	ctp, int code, unsigned flags, void* handle);
+int IoMixed	(message_context_t*	ctp, int code, unsigned flags, void* handle);
 
 //
 // resmgr globals
@@ -46,6 +56,9 @@ struct Device
 
 	const char*		name;
 	int				unlimited;
+
+	// ionotify() waiters on this device, per condition
+	iofunc_notify_t	notify[3];
 };
 
 typedef struct Device Device;
@@ -78,14 +91,12 @@ void DeviceAttach(dispatch_t* dpp)
 }
 
 //
-// Blocked ionotify() and read() support queues.
+// Blocked read() support queue.
 //
-// Perhaps these could be part of Device, but since all the devices
-// read from the same pool of entropy, they're global.
+// Perhaps this could be part of Device, but since all the devices
+// read from the same pool of entropy, it's global.
 //
 
-iofunc_notify_t	notifications[3];
-
 struct BlockedRead
 {
 	int		rcvid;
@@ -99,17 +110,20 @@ typedef struct BlockedRead BlockedRead;
 
 BlockedRead*	blocked;
 
+Pool			blockedPool = POOL_INIT("BlockedRead", BlockedRead);
+
 int QueueRead(int rcvid, int nbytes)
 {
 	BlockedRead** rq = &blocked;
 	struct _msg_info info;
-	BlockedRead* r = malloc(sizeof(BlockedRead));
+	BlockedRead* r = (BlockedRead*) PoolAlloc(&blockedPool);
 
 	if(!r) {
-		return errno;
+		return ENOMEM;
 	}
 
 	if(MsgInfo(rcvid, &info) == -1) {
+		PoolFree(&blockedPool, r);
 		return errno;
 	}
 
@@ -128,6 +142,206 @@ int QueueRead(int rcvid, int nbytes)
 	return EOK;
 }
 
+//
+// The entropy pool
+//
+// With deferred mixing (-r), IoPulse() only timestamps the interrupt
+// into a ring, and a low priority thread drains the ring into the
+// pool in bulk, so the interrupt can be unmasked without dragging the
+// pool through the cache first. The pool is then shared between that
+// thread and the resmgr thread, so all the random.c calls are made
+// with the pool locked.
+//
+
+static pthread_mutex_t	pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define PoolLock()		pthread_mutex_lock(&pool_mutex)
+#define PoolUnlock()	pthread_mutex_unlock(&pool_mutex)
+
+#define barrier()		__asm__ __volatile__("" ::: "memory")
+
+#define RING_SIZE	256	// power of 2
+
+struct Sample
+{
+	unsigned	time;
+	unsigned	high;
+	int			irq;
+};
+
+typedef struct Sample Sample;
+
+// Single producer (IoPulse), single consumer (Mixer), lock-free: only
+// IoPulse writes ringHead, and only Mixer writes ringTail.
+static Sample				ring[RING_SIZE];
+static volatile unsigned	ringHead;
+static volatile unsigned	ringTail;
+static unsigned				ringOverruns;
+static sem_t				ringSem;
+
+static int	mixCoid = -1;
+static int	mixCode = -1;
+
+int RingPut(unsigned time, unsigned high, int irq)
+{
+	unsigned head = ringHead;
+	Sample* s = &ring[head & (RING_SIZE - 1)];
+
+	if(head - ringTail == RING_SIZE) {
+		ringOverruns++;
+		return 0;
+	}
+	s->time = time;
+	s->high = high;
+	s->irq = irq;
+
+	// the sample must be written before it is published
+	barrier();
+	ringHead = head + 1;
+
+	return 1;
+}
+void* Mixer(void* arg)
+{
+	arg = arg;
+
+	while(1) {
+		unsigned tail = ringTail;
+		unsigned head;
+
+		if(sem_wait(&ringSem) == -1)
+			continue;
+
+		head = ringHead;
+		barrier();
+
+		if(tail == head)
+			continue;
+
+		PoolLock();
+		for(; tail != head; tail++) {
+			Sample* s = &ring[tail & (RING_SIZE - 1)];
+			add_interrupt_sample(s->irq, s->time, s->high);
+		}
+		PoolUnlock();
+
+		barrier();
+		ringTail = tail;
+
+		// let the resmgr thread wake up readers and notifications
+		if(MsgSendPulse(mixCoid, -1, mixCode, 0) == -1) {
+			Warn("MsgSendPulse failed: [%d] %s\n", ERR(errno));
+		}
+	}
+	return 0;
+}
+void StartMixer(dispatch_t* dpp)
+{
+	pthread_attr_t		attr;
+	struct sched_param	param;
+	int					e;
+
+	if(sem_init(&ringSem, 0, 0) == -1) {
+		Error("sem_init failed: [%d] %s\n", ERR(errno));
+	}
+
+	mixCode = pulse_attach(dpp, MSG_FLAG_ALLOC_PULSE, 0, IoMixed, 0);
+	if(mixCode == -1) {
+		Error("pulse_attach failed: [%d] %s\n", ERR(errno));
+	}
+	mixCoid = message_connect(dpp, MSG_FLAG_SIDE_CHANNEL);
+	if(mixCoid == -1) {
+		Error("message_connect failed: [%d] %s\n", ERR(errno));
+	}
+
+	// run below the resmgr thread, mixing can always wait
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_RR);
+	param.sched_priority = max(1, getprio(0) - 1);
+	pthread_attr_setschedparam(&attr, &param);
+
+	if((e = pthread_create(0, &attr, Mixer, 0)) != EOK) {
+		Error("pthread_create failed: [%d] %s\n", ERR(e));
+	}
+}
+
+//
+// With -f, /dev/urandom reads come from a generator's key, and a
+// thread reseeds it from the pool when random.c's policy says it's
+// due, so reads never wait for the pool to be hashed. Readers only lock
+// the key. The reseeder locks the pool to hash it, and then the key to
+// install the seed. Anything needing both takes the pool first.
+//
+
+static pthread_mutex_t	key_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define KeyLock()		pthread_mutex_lock(&key_mutex)
+#define KeyUnlock()		pthread_mutex_unlock(&key_mutex)
+
+#define RESEED_POLL	1	// seconds between checks for a reseed being due
+
+static int	reseeding;
+
+void* Reseeder(void* arg)
+{
+	unsigned	seed[RAND_SEED_WORDS];
+	int			due;
+	int			starved;
+
+	arg = arg;
+
+	while(1) {
+		sleep(RESEED_POLL);
+
+		PoolLock();
+		due = rand_reseed_due();
+		starved = rand_reseed_starved();
+		if(due)
+			rand_reseed_extract(seed);
+		PoolUnlock();
+
+		LogStarved(starved);
+
+		if(!due)
+			continue;
+
+		KeyLock();
+		rand_reseed_install(seed);
+		KeyUnlock();
+
+		memset(seed, 0, sizeof(seed));
+	}
+	return 0;
+}
+void StartReseeder()
+{
+	pthread_attr_t		attr;
+	struct sched_param	param;
+	int					e;
+
+	// the first seed, before there are any readers
+	PoolLock();
+	rand_reseed();
+	PoolUnlock();
+
+	rand_reseed_schedule(1);
+	reseeding = 1;
+
+	// like the Mixer, reseeding can wait for the resmgr thread
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+	pthread_attr_setschedpolicy(&attr, SCHED_RR);
+	param.sched_priority = max(1, getprio(0) - 1);
+	pthread_attr_setschedparam(&attr, &param);
+
+	if((e = pthread_create(0, &attr, Reseeder, 0)) != EOK) {
+		Error("pthread_create failed: [%d] %s\n", ERR(e));
+	}
+}
+
 //
 // Attach to our entropy source
 //
@@ -157,11 +371,17 @@ void AttachEntropy(dispatch_t* dpp)
  	se.sigev_priority = -1;
 	se.sigev_value.sival_int = options.irq; // set to the irq no
 
-	rand_initialize();
+	if(options.ring) {
+		StartMixer(dpp);
+	}
 
 	if(!rand_initialize_irq(options.irq)) {
 		Error("rand initialize irq failed!\n");
 	}
+	rand_set_estimator(options.irq, options.estimator);
+	rand_set_output(options.output);
+	rand_set_reseed_policy(options.reseedBits, options.reseedSecs);
+
 	irqId = InterruptAttachEvent(options.irq, &se,
 		_NTO_INTR_FLAGS_PROCESS|_NTO_INTR_FLAGS_TRK_MSK);
 
@@ -174,15 +394,29 @@ void AttachEntropy(dispatch_t* dpp)
 // main
 //
 
+static volatile int terminate;
+
+void Terminate(int signo)
+{
+	terminate = signo;
+}
+
 int main(int argc, char *argv[])
 {
 	dispatch_t*			dpp = 0;
 	dispatch_context_t*	ctp = 0;
 
+	StartupMark("start");
+
 	GetOpts(argc, argv);
 
 	Fork();
 
+	// the pool is seeded with the time of day, cheaply, so it's
+	// ready for use as soon as the devices are attached
+	rand_initialize();
+	StartupMark("pool");
+
 	// initialize dispatch interface
 	dpp = dispatch_create();
 
@@ -195,8 +429,9 @@ int main(int argc, char *argv[])
 		_RESMGR_IO_NFUNCS, &io_funcs);
 
 	io_funcs.read = IoRead;
-	io_funcs.write = 0; // ENOSYS
+	io_funcs.write = IoWrite;
 	io_funcs.notify = IoNotify;
+	io_funcs.devctl = IoDevctl;
 	io_funcs.stat = IoStat;
 	io_funcs.lseek = IoLseek;
 
@@ -214,24 +449,87 @@ int main(int argc, char *argv[])
 	if(!ctp) {
 		Error("unable to alloc context!\n");
 	}
+	StartupMark("attach");
+
+	// opens now block until we get to the message loop, rather than
+	// fail, so let whoever started us carry on
 
-	// attach to our entropy source
+	Daemonize();
+
+	// attach to our entropy source, and do the slower seeding
 
 	AttachEntropy(dpp);
+	StartupMark("irq");
+
+	if(options.seed) {
+		PoolLock();
+		SeedLoad(options.seed, options.credit);
+		PoolUnlock();
+	}
+	StartupMark("seed");
+
+	// after the seed file, so it's in the generator's first key
+	if(options.output == RAND_OUT_FKE) {
+		StartReseeder();
+	}
+
+	LogCycles();
 
 	// start the resource manager message loop
 
-	Daemonize();
+	signal(SIGTERM, Terminate);
 
-	while(1) {
-		dispatch_context_t* c = dispatch_block(ctp);
+	while(!terminate) {
+		dispatch_context_t* c = 0;
+
+		LogPoll();
+
+		c = dispatch_block(ctp);
 
 		if(!c) {
-			Log("dispatch_block() failed: [%d] %s\n", ERR(errno));
+			if(errno != EINTR)
+				Warn("dispatch_block() failed: [%d] %s\n", ERR(errno));
 			continue;
 		}
+		logRequest++;
+
 		dispatch_handler(c);
 	}
+
+	if(options.seed) {
+		PoolLock();
+		SeedSave(options.seed);
+		PoolUnlock();
+	}
+
+	Debug("irq samples lost to ring overruns %u", ringOverruns);
+
+	KeyLock();
+	LogReseeds();
+	KeyUnlock();
+
+	PoolLog(&blockedPool);
+
+	return 0;
+}
+//
+// Wake writers waiting for the pool to run low, after entropy has been
+// extracted from it.
+//
+void NotifyOutput()
+{
+	int	i;
+	int	low;
+
+	PoolLock();
+	low = rand_output_ready();
+	PoolUnlock();
+
+	if(!low)
+		return;
+
+	for(i = 0; i < sizeof(attrs)/sizeof(attrs[0]); ++i)
+		iofunc_notify_trigger(attrs[i].notify, 1, IOFUNC_NOTIFY_OUTPUT);
 }
 int IoRead (resmgr_context_t *ctp, io_read_t *msg, RESMGR_OCB_T *ocb)
 {
@@ -254,6 +552,23 @@ int IoRead (resmgr_context_t *ctp, io_read_t *msg, RESMGR_OCB_T *ocb)
 		return EOK;
 	}
 
+	// the reseeder has the pool, reading only needs the key
+	if(ocb->attr->unlimited && reseeding) {
+		nbytes = min(msg->i.nbytes, sizeof(buffer));
+
+		KeyLock();
+		get_urandom_bytes(buffer, nbytes);
+		KeyUnlock();
+
+		resmgr_msgwrite(ctp, buffer, nbytes, 0);
+		_IO_SET_READ_NBYTES (ctp, nbytes);
+		ocb->attr->ioa.flags |= IOFUNC_ATTR_ATIME;
+
+		return EOK;
+	}
+
+	PoolLock();
+
 	if(ocb->attr->unlimited)
 		nleft = sizeof(buffer);
 	else
@@ -267,10 +582,17 @@ int IoRead (resmgr_context_t *ctp, io_read_t *msg, RESMGR_OCB_T *ocb)
 	if (nbytes > 0) {
 		// write the data into the clients buffer
 
-		get_random_bytes(buffer, nbytes);
+		if(ocb->attr->unlimited)
+			get_urandom_bytes(buffer, nbytes);
+		else
+			get_random_bytes(buffer, nbytes);
+
+		PoolUnlock();
 
 //		Log("IoRead: remaining %d\n", get_random_size());
 
+		NotifyOutput();
+
 		resmgr_msgwrite(ctp, buffer, nbytes, 0);
 
 		//  set up the number of bytes (returned by client's read())
@@ -280,6 +602,8 @@ int IoRead (resmgr_context_t *ctp, io_read_t *msg, RESMGR_OCB_T *ocb)
 		// dirty the access time
 		ocb->attr->ioa.flags |= IOFUNC_ATTR_ATIME;
 	} else {
+		PoolUnlock();
+
 //		Log("IoRead: nbytes %d nleft %d nonblock %d\n",
 //			msg->i.nbytes, nleft, nonblock ? 1 : 0);
 
@@ -297,68 +621,340 @@ int IoRead (resmgr_context_t *ctp, io_read_t *msg, RESMGR_OCB_T *ocb)
 
 	return status;
 }
+//
+// Like Linux's random_write(), data written is mixed into the pool, but
+// not credited with any entropy.
+//
+int IoWrite(resmgr_context_t* ctp, io_write_t* msg, RESMGR_OCB_T* ocb)
+{
+	char	buffer[BUFSIZ];
+	int		offset = 0;
+	int		status;
+	int		n;
+
+	if((status = iofunc_write_verify(ctp, msg, ocb, 0)) != EOK)
+		return status;
+
+	if((msg->i.xtype & _IO_XTYPE_MASK) != _IO_XTYPE_NONE)
+		return ENOSYS;
+
+	while(offset < msg->i.nbytes) {
+		n = min(sizeof(buffer), msg->i.nbytes - offset);
+		n = resmgr_msgread(ctp, buffer, n, sizeof(msg->i) + offset);
+
+		if(n <= 0)
+			break;
+
+		PoolLock();
+		add_random_bytes(buffer, n, 0);
+		PoolUnlock();
+
+		offset += n;
+	}
+	memset(buffer, 0, sizeof(buffer));
+
+	_IO_SET_WRITE_NBYTES(ctp, offset);
+
+	// dirty the modification time
+	if(offset > 0)
+		ocb->attr->ioa.flags |= IOFUNC_ATTR_MTIME | IOFUNC_ATTR_CTIME;
+
+	return EOK;
+}
 void UnblockReads()
 {
 	BlockedRead** rq = &blocked;
 	int	sz;
 
-	while(*rq && (sz = get_random_size()))
+	while(*rq)
 	{
 		BlockedRead* r = *rq;
 
 		char	buffer[BUFSIZ];
-		int		nbytes = min(r->nbytes, sz);
+		int		nbytes;
+
+		PoolLock();
 
+		if(!(sz = get_random_size())) {
+			PoolUnlock();
+			break;
+		}
+
+		nbytes = min(r->nbytes, sz);
 		nbytes = min(sizeof(buffer), nbytes);
 
 		get_random_bytes(buffer, nbytes);
 
+		PoolUnlock();
+
 		if(MsgReply(r->rcvid, nbytes, buffer, nbytes) == -1) {
 			MsgReply(r->rcvid, -errno, 0, 0);
 		}
 		*rq = r->next;
 
-		free(r);
+		PoolFree(&blockedPool, r);
+
+		NotifyOutput();
 	}
 }
+//
+// Wake readers, blocked or waiting in ionotify(), now that the pool
+// holds sz bytes.
+//
+void NotifyInput(int sz)
+{
+	// unblock pending ionotify(), only /dev/random ever has to wait
+	if(sz > 0)
+		iofunc_notify_trigger(attrs[0].notify, sz, IOFUNC_NOTIFY_INPUT);
+
+	// unblock pending read()
+	UnblockReads();
+}
 int IoPulse(message_context_t* ctp, int code, unsigned flags, void* handle)
 {
 	union sigval sv = ctp->msg->pulse.value;
 	int irqid = *(int*)handle;
 
+	if(options.ring) {
+		unsigned high;
+		unsigned time = cycles_read(&high);
+
+		RingPut(time, high, options.irq);
+
+		InterruptUnmask(sv.sival_int, irqid);
+
+		// the Mixer will pulse IoMixed() when it's done
+		sem_post(&ringSem);
+
+		return 0;
+	}
+
+	PoolLock();
 	add_interrupt_randomness(options.irq);
+	PoolUnlock();
 
 	InterruptUnmask(sv.sival_int, irqid);
 
-//	Log("IoPulse: nbytes %d\n", get_random_size());
+	return IoMixed(ctp, code, flags, handle);
+}
+int IoMixed(message_context_t* ctp, int code, unsigned flags, void* handle)
+{
+	int sz;
+
+	PoolLock();
+	SeedTick(options.seed);
+	rand_tcp_rekey();
+	sz = get_random_size();
+	PoolUnlock();
 
-	// unblock pending ionotify()
-	iofunc_notify_trigger(
-		notifications, get_random_size(), IOFUNC_NOTIFY_INPUT);
+//	Log("IoMixed: nbytes %d\n", sz);
 
-	// unblock pending read()
-	UnblockReads();
+	NotifyInput(sz);
 
 	return 0;
 }
 int IoNotify(resmgr_context_t* ctp, io_notify_t* msg, RESMGR_OCB_T* ocb)
 {
-	int trig = _NOTIFY_COND_OUTPUT|_NOTIFY_COND_OBAND;
+	int trig = _NOTIFY_COND_OBAND;
 	int	e;
 	int	a = 0;
 
-	if(ocb->attr->unlimited || get_random_size() > 0) {
+	PoolLock();
+	if(ocb->attr->unlimited || rand_input_ready()) {
 		trig |= _NOTIFY_COND_INPUT;
 	}
-	e = iofunc_notify(ctp, msg, notifications, trig, 0, &a);
+	// writeable when the pool is low, so feeders only wake when needed
+	if(rand_output_ready()) {
+		trig |= _NOTIFY_COND_OUTPUT;
+	}
+	PoolUnlock();
+	e = iofunc_notify(ctp, msg, ocb->attr->notify, trig, 0, &a);
 
 //	Log("IoNotify: input rdy %d armed %d\n", trig & _NOTIFY_COND_INPUT, a);
 
 	return e;
 }
+int ClientIsRoot(resmgr_context_t* ctp)
+{
+	struct _client_info info;
+
+	if(iofunc_client_info(ctp, 0, &info) != EOK)
+		return 0;
+
+	return info.cred.euid == 0;
+}
+//
+// TCP initial sequence numbers: the client sends an array of
+// struct tcp_endpoints, and gets back an unsigned sequence number for
+// each. The array can be larger than the message buffer, so it's read
+// and answered a chunk at a time.
+//
+int TcpSequence(resmgr_context_t* ctp, io_devctl_t* msg)
+{
+	struct tcp_endpoints	ep[64];
+	unsigned				seq[64];
+	int						n = msg->i.nbytes / sizeof(ep[0]);
+	int						done = 0;
+	int						c;
+
+	while(done < n) {
+		c = min(n - done, sizeof(ep)/sizeof(ep[0]));
+
+		if(resmgr_msgread(ctp, ep, c * sizeof(ep[0]),
+				sizeof(msg->i) + done * sizeof(ep[0])) == -1)
+			return errno;
+
+		PoolLock();
+		secure_tcp_sequence_numbers(ep, seq, c);
+		PoolUnlock();
+
+		if(resmgr_msgwrite(ctp, seq, c * sizeof(seq[0]),
+				sizeof(msg->o) + done * sizeof(seq[0])) == -1)
+			return errno;
+
+		done += c;
+	}
+
+	memset(&msg->o, 0, sizeof(msg->o));
+	msg->o.nbytes = n * sizeof(seq[0]);
+
+	return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o));
+}
+//
+// SYN cookies: the array of struct tcp_syn_cookie is minted or checked
+// in place, a chunk at a time, as with TcpSequence().
+//
+int SynCookies(resmgr_context_t* ctp, io_devctl_t* msg)
+{
+	struct tcp_syn_cookie	c[64];
+	int						n = msg->i.nbytes / sizeof(c[0]);
+	int						done = 0;
+	int						k;
+
+	while(done < n) {
+		k = min(n - done, sizeof(c)/sizeof(c[0]));
+
+		if(resmgr_msgread(ctp, c, k * sizeof(c[0]),
+				sizeof(msg->i) + done * sizeof(c[0])) == -1)
+			return errno;
+
+		PoolLock();
+		if(msg->i.dcmd == DCMD_RANDOM_SYNCOOKIE)
+			secure_tcp_syn_cookies(c, k);
+		else
+			check_tcp_syn_cookies(c, k, DCMD_RANDOM_SYNMAXDIFF);
+		PoolUnlock();
+
+		if(resmgr_msgwrite(ctp, c, k * sizeof(c[0]),
+				sizeof(msg->o) + done * sizeof(c[0])) == -1)
+			return errno;
+
+		done += k;
+	}
+
+	memset(&msg->o, 0, sizeof(msg->o));
+	msg->o.nbytes = n * sizeof(c[0]);
+
+	return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o));
+}
+//
+// A fixed size reply with the entropy count, so health checks needn't
+// stat() the device, and root control of the count, as with the Linux
+// random ioctls.
+//
+int IoDevctl(resmgr_context_t* ctp, io_devctl_t* msg, RESMGR_OCB_T* ocb)
+{
+	int*	data = (int*) _DEVCTL_DATA(msg->i);
+	int		nbytes = 0;
+	int		sz;
+	int		status;
+
+	if((status = iofunc_devctl_default(ctp, msg, ocb)) != _RESMGR_DEFAULT)
+		return status;
+
+	switch(msg->i.dcmd) {
+		case DCMD_RANDOM_GETENTCNT:
+			PoolLock();
+			*data = rand_get_entcnt();
+			PoolUnlock();
+
+			nbytes = sizeof(*data);
+			break;
+
+		case DCMD_RANDOM_ADDTOENTCNT:
+			if(!ClientIsRoot(ctp))
+				return EPERM;
+			if(msg->i.nbytes < sizeof(*data))
+				return EINVAL;
+
+			PoolLock();
+			rand_add_entcnt(*data);
+			sz = get_random_size();
+			PoolUnlock();
+
+			// the count can go either way
+			NotifyInput(sz);
+			NotifyOutput();
+			break;
+
+		case DCMD_RANDOM_TCPSEQ:
+			// the numbers are only unguessable if only the stack sees them
+			if(!ClientIsRoot(ctp))
+				return EPERM;
+			return TcpSequence(ctp, msg);
+
+		case DCMD_RANDOM_SYNCOOKIE:
+		case DCMD_RANDOM_SYNCHECK:
+			// or anyone could mint cookies for spoofed connections
+			if(!ClientIsRoot(ctp))
+				return EPERM;
+			return SynCookies(ctp, msg);
+
+		case DCMD_RANDOM_ZAPENTCNT:
+		case DCMD_RANDOM_CLEARPOOL:
+			if(!ClientIsRoot(ctp))
+				return EPERM;
+
+			// clearing the pool clears the key, which has to be
+			// reseeded before a reader finds it
+			PoolLock();
+			KeyLock();
+			if(msg->i.dcmd == DCMD_RANDOM_ZAPENTCNT)
+				rand_zap_entcnt();
+			else
+				rand_clear_pool();
+			if(reseeding && msg->i.dcmd == DCMD_RANDOM_CLEARPOOL)
+				rand_reseed();
+			KeyUnlock();
+			PoolUnlock();
+
+			NotifyOutput();
+			break;
+
+		case DCMD_RANDOM_RESEEDSTATS:
+			KeyLock();
+			rand_get_reseed_stats((struct rand_reseed_stats*) data);
+			KeyUnlock();
+
+			nbytes = sizeof(struct rand_reseed_stats);
+			break;
+
+		default:
+			return ENOSYS;
+	}
+
+	memset(&msg->o, 0, sizeof(msg->o));
+	msg->o.nbytes = nbytes;
+
+	return _RESMGR_PTR(ctp, &msg->o, sizeof(msg->o) + nbytes);
+}
 int IoStat(resmgr_context_t* ctp, io_stat_t* msg, RESMGR_OCB_T* ocb)
 {
-	int sz = get_random_size();
+	int sz;
+
+	PoolLock();
+	sz = get_random_size();
+	PoolUnlock();
 
 	ocb->attr->ioa.nbytes = sz;
 
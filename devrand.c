@@ -25,6 +25,7 @@
 #include <fcntl.h>
 #include <signal.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -39,8 +40,11 @@
 #include <sys/types.h>
 
 #include "devrand.h"
+#include "cycles.h"
 #include "devrandirq.h"
+#include "pool.h"
 #include "random.h"
+#include "seed.h"
 #include "util.h"
 
 int		Service(pid_t pid, Msg* msg);
@@ -52,7 +56,9 @@ void	ReplyMsg(pid_t pid, const void* msg, size_t size);
 Ocb*	FdGet(pid_t pid, int fd);
 int		FdMap(pid_t pid, int dst_fd, Ocb* ocb);
 int		FdUnMap(pid_t pid, int fd);
-void	FdGetPrio(pid_t pid, int* priority);
+int		FdGetPrio(pid_t pid);
+void	FdGetIds(pid_t pid, int* uid, int* gid);
+void	FdGetInfo(pid_t pid, int* priority, int* uid, int* gid);
 
 const char* MessageName(msg_t type);
 const char* HandleOflagName(short int oflag);
@@ -105,7 +111,7 @@ void DeviceInit()
 		s->st_mtime	=
 		s->st_atime	= 
 		s->st_ctime	= time(0);
-		s->st_mode	= S_IFCHR | 0444; /* r-- r-- r-- */
+		s->st_mode	= S_IFCHR | 0666; /* rw- rw- rw- */
 		s->st_nlink	= 1;
 	}
 	/* despite the loop above, we only have 2 units, one unlimited,
@@ -122,13 +128,21 @@ void DeviceInit()
 * Request Queues
 */
 
+Pool	ocbPool			= POOL_INIT("Ocb", Ocb);
+Pool	readPool		= POOL_INIT("ReadRequest", ReadRequest);
+Pool	armedPool		= POOL_INIT("ArmedPid", ArmedPid);
+
 ReadRequest* readq;
 
 void QueueReadRequest(ReadRequest* r)
 {
 	ReadRequest** rq = &readq;
 
-	FdGetPrio(r->pid, &r->priority);
+	// the Ocb only has the opener's, the fd may have been passed on
+	if(r->pid == r->ocb->pid)
+		r->priority = r->ocb->priority;
+	else
+		r->priority = FdGetPrio(r->pid);
 
 	while(*rq && (*rq)->priority >= r->priority)
 		rq = &(*rq)->next;
@@ -138,44 +152,128 @@ void QueueReadRequest(ReadRequest* r)
 	*rq = r;
 }
 
-ArmedPid*	armedq;
+/*
+* Select Waiters
+*
+* A select() on one of our fds that can't be satisfied yet is armed
+* on a list for its unit and condition, so only the clients waiting
+* for something that has just happened are triggered. Each armed
+* entry is also hashed by pid, so a _SEL_POLL disarms a client
+* without searching every list.
+*/
+
+#define SEL_COND_INPUT	0
+#define SEL_COND_OUTPUT	1
+#define SEL_CONDS		2
+
+#define SEL_PIDHASH		64
 
-int SelectArm(pid_t pid, pid_t proxy)
+ArmedPid	waiters[2][SEL_CONDS];
+ArmedPid*	armedPids[SEL_PIDHASH];
+
+#define PidHash(PID)	(((unsigned) (PID)) % SEL_PIDHASH)
+
+void SelectInit()
 {
-	ArmedPid* a = (struct ArmedPid*) malloc(sizeof(struct ArmedPid));
+	int unit;
+	int cond;
+
+	for(unit = 0; unit < 2; ++unit) {
+		for(cond = 0; cond < SEL_CONDS; ++cond) {
+			ArmedPid* w = &waiters[unit][cond];
+			w->next = w->prev = w;
+		}
+	}
+}
+int SelectReady(int unit, int cond)
+{
+	switch(cond) {
+		case SEL_COND_INPUT:
+			return Unit(unit)->unlimited || rand_input_ready();
+		case SEL_COND_OUTPUT:
+			return rand_output_ready();
+	}
+	return 1;
+}
+int SelectArm(pid_t pid, pid_t proxy, int unit, int cond)
+{
+	ArmedPid** bucket = &armedPids[PidHash(pid)];
+	ArmedPid* w = &waiters[unit][cond];
+	ArmedPid* a;
+
+	// a client with several fds on the same unit only needs arming once
+	for(a = *bucket; a; a = a->pidnext) {
+		if(a->pid == pid && a->unit == unit && a->cond == cond) {
+			a->proxy = proxy;
+			return EOK;
+		}
+	}
+
+	a = (ArmedPid*) PoolAlloc(&armedPool);
 
 	if(!a)
 		return ENOMEM;
 
 	a->pid = pid;
 	a->proxy = proxy;
+	a->unit = unit;
+	a->cond = cond;
 
-	a->next = armedq;
+	a->next = w;
+	a->prev = w->prev;
+	w->prev->next = a;
+	w->prev = a;
 
-	armedq = a;
+	a->pidnext = *bucket;
+	*bucket = a;
 
 	return EOK;
 }
-void SelectDisarm(pid)
+void SelectDisarm(pid_t pid)
 {
-	ArmedPid** ap = &armedq;
+	ArmedPid** ap = &armedPids[PidHash(pid)];
+
+	while(*ap) {
+		ArmedPid* a = *ap;
+
+		if(a->pid != pid) {
+			ap = &a->pidnext;
+			continue;
+		}
+		*ap = a->pidnext;
 
-	while(*ap && (*ap)->pid != pid)
-		ap = &(*ap)->next;
+		a->prev->next = a->next;
+		a->next->prev = a->prev;
 
-	if(*ap) {
-		*ap = (*ap)->next;
-		free(*ap);
+		PoolFree(&armedPool, a);
 	}
 }
-void SelectTrigger()
+/*
+* Trigger the clients waiting on unit for cond, if it now holds. Input
+* waiters are woken in the order they armed, one per byte of entropy
+* available, so a trickle of entropy doesn't wake every client only
+* for all but one of them to find the pool empty again.
+*/
+void SelectTrigger(int unit, int cond)
 {
-	while(armedq) {
-		ArmedPid* a = armedq;
-		armedq = a->next;
+	ArmedPid* w = &waiters[unit][cond];
+	int	budget = -1;
+
+	if(w->next == w || !SelectReady(unit, cond))
+		return;
+
+	if(cond == SEL_COND_INPUT && !Unit(unit)->unlimited)
+		budget = get_random_size();
 
-		Trigger(a->proxy);
-		free(a);
+	while(w->next != w && budget != 0) {
+		pid_t proxy = w->next->proxy;
+
+		// the client will poll all of its fds when it wakes up
+		SelectDisarm(w->next->pid);
+		Trigger(proxy);
+
+		if(budget > 0)
+			budget--;
 	}
 }
 
@@ -193,28 +291,119 @@ struct _sysmsg_version_reply version = {
 
 Msg	msg;
 
+/*
+* Statistics, logged on exit in debug mode
+*/
+
+struct Stats
+{
+	unsigned	messages;	// from clients
+	unsigned	irqs;		// irq proxies received
+	unsigned	overruns;	// irq proxies that overran, each is a lost sample
+};
+
+struct Stats stats;
+
+/*
+* Service() benchmarking
+*
+* Build with SERVICE_BENCHMARK defined (make SERVICE_BENCHMARK=1) to
+* time each Service() call in cycles, and log the min/avg/max, and the
+* message rate, every BENCHMARK_INTERVAL messages.
+*/
+
+#ifdef SERVICE_BENCHMARK
+#define BENCHMARK_INTERVAL 1000
+
+struct ServiceBenchmark
+{
+	int			times;
+	unsigned	min;
+	unsigned	max;
+	unsigned	accum;
+
+	struct timespec	start;
+};
+
+struct ServiceBenchmark service_benchmark = { 0, ~0u, 0, 0 };
+
+void ServiceBenchmarkAdd(unsigned ticks)
+{
+	struct ServiceBenchmark* b = &service_benchmark;
+
+	if(b->times == 0)
+		clock_gettime(CLOCK_REALTIME, &b->start);
+
+	if(ticks < b->min)
+		b->min = ticks;
+	if(ticks > b->max)
+		b->max = ticks;
+	b->accum += ticks;
+	if(++b->times == BENCHMARK_INTERVAL) {
+		struct timespec end;
+		long ms;
+
+		clock_gettime(CLOCK_REALTIME, &end);
+		ms = (end.tv_sec - b->start.tv_sec) * 1000
+			+ (end.tv_nsec - b->start.tv_nsec) / 1000000;
+
+		Log("Service benchmark: %u min, %u avg, %u max cycles, %ld msgs/s",
+			b->min, b->accum / BENCHMARK_INTERVAL, b->max,
+			ms > 0 ? BENCHMARK_INTERVAL * 1000L / ms : 0L);
+		b->times = 0;
+		b->min = ~0u;
+		b->max = 0;
+		b->accum = 0;
+	}
+}
+#endif
+
 /*
 * Main
 */
 int main(int argc, char* argv[])
 {
+	StartupMark("start");
+
 	GetOpts(argc, argv);
 
 	Fork();
 
 	SetProcessFlags();
 
+	// the pool is seeded with the time of day, cheaply, so it's
+	// ready for use as soon as the prefixes are attached
 	rand_initialize();
+	StartupMark("pool");
 
 	DeviceInit();
 	FdInit();
+	SelectInit();
 
 	AttachPrefix("/dev/random", UNIT_RANDOM);
 	AttachPrefix("/dev/urandom", UNIT_URANDOM);
+	StartupMark("attach");
+
+	// let whoever started us carry on, opens will now block until
+	// we get to the Loop(), rather than fail
+	Daemonize();
 
+	// the slower startup work is done after that
 	HookIrqs();
+	StartupMark("irq");
 
-	Daemonize();
+	if(options.seed)
+		SeedLoad(options.seed, options.credit);
+	StartupMark("seed");
+
+	// with -f, reads only use the generator's key, and Loop() reseeds
+	// it between messages, there being no thread to do it on
+	if(options.output == RAND_OUT_FKE) {
+		rand_reseed();
+		rand_reseed_schedule(1);
+	}
+
+	LogCycles();
 
 	return Loop();
 }
@@ -229,6 +418,9 @@ void HookIrqs()
 	if(!rand_initialize_irq(options.irq)) {
 		Error("Attach to %d failed: [%d] %s\n", options.irq, ERR(ENOMEM));
 	}
+	rand_set_estimator(options.irq, options.estimator);
+	rand_set_output(options.output);
+	rand_set_reseed_policy(options.reseedBits, options.reseedSecs);
 }
 void SetProcessFlags()
 {
@@ -257,32 +449,59 @@ int Loop()
 
 	while(link_count > 0)
 	{
+		LogPoll();
+
 		pid = Receive(0, &msg, sizeof(msg));
 
 		if(pid == -1) {
 			if(errno != EINTR) {
-				Log("Receive() failed: [%d] %s", ERR(errno));
+				Warn("Receive() failed: [%d] %s", ERR(errno));
 			}
 			continue;
 		}
 		if(pid == IrqProxy()) {
+			stats.irqs++;
+
+			// clear out any proxy overruns, they're lost samples
 			while(Creceive(pid, 0, 0) == pid)
-				; // clear out any proxy overruns
+				stats.overruns++;
 
 			add_interrupt_randomness(options.irq);
 
+			SeedTick(options.seed);
+
+			// irqs are the one regular wakeup, and bring the entropy
+			if(options.output == RAND_OUT_FKE) {
+				if(rand_reseed_due())
+					rand_reseed();
+				LogStarved(rand_reseed_starved());
+			}
+
 //			Log("Irq: random size %d\n", get_random_size());
 
 			// now that we have more entropy...
-			SelectTrigger();
+			SelectTrigger(UNIT_RANDOM, SEL_COND_INPUT);
 			DoReadQueue();
 
 			continue;
 		}
 
+		logRequest = ++stats.messages;
+
+#ifdef SERVICE_BENCHMARK
+		{
+			unsigned high;
+			unsigned start = cycles_read(&high);
+
+			status = Service(pid, &msg);
+
+			ServiceBenchmarkAdd(cycles_read(&high) - start);
+		}
+#else
 		status = Service(pid, &msg);
+#endif
 
-		Log("Service() returned status %d (%s), link_count %d",
+		Debug("Service() returned status %d (%s), link_count %d",
 			status, status == -1 ? "none" : strerror(status), link_count);
 
 		if(status >= EOK) {
@@ -290,20 +509,26 @@ int Loop()
 			ReplyMsg(pid, &msg, sizeof(msg.status));
 		}
 	}
+
+	Debug("messages %u, irqs %u, irq overruns %u",
+		stats.messages, stats.irqs, stats.overruns);
+
+	LogReseeds();
+
+	PoolLog(&ocbPool);
+	PoolLog(&readPool);
+	PoolLog(&armedPool);
+
 	return 0;
 }
-int CheckPerms(pid_t pid, mode_t mode, int unit)
+int CheckPerms(int uid, int gid, mode_t mode, int unit)
 {
 	static const basemodes[] = { S_IROTH, S_IWOTH, S_IROTH|S_IWOTH, 0 };
-	int	uid;
-	int	gid;
 	unsigned fuid	= Unit(unit)->stat.st_ouid;
 	unsigned fgid	= Unit(unit)->stat.st_ogid;
 	unsigned fmode	= Unit(unit)->stat.st_mode;
 	unsigned okmode	= 0;
 
-	FdGetIds(pid, &uid, &gid);
-
 	mode = basemodes[mode & O_ACCMODE];
 
 	if (uid == 0) {
@@ -321,7 +546,7 @@ int Service(pid_t pid, Msg* msg)
 {
 	int status = -1;
 
-	Log("Service() pid %d type %s (%#x)",
+	Debug("Service() pid %d type %s (%#x)",
 		pid, MessageName(msg->type), msg->type);
 
 	switch(msg->type)
@@ -393,10 +618,13 @@ int Service(pid_t pid, Msg* msg)
 				break;
 			}
 
+			if(options.seed)
+				SeedSave(options.seed);
+
 			// reply with EOK, then exit
 			status = EOK;
 			if(qnx_prefix_detach(path) == -1) {
-				Log("detach %s failed: [%d] %s\n", path, ERR(errno));
+				Warn("detach %s failed: [%d] %s\n", path, ERR(errno));
 				status = errno;
 			} else {
 				link_count--;
@@ -469,7 +697,7 @@ int Service(pid_t pid, Msg* msg)
 			break;
 		
 		default:
-			Log("unknown msg type SYSMSG subtype %s (%d)",
+			Warn("unknown msg type SYSMSG subtype %s (%d)",
 				SysmsgSubtypeName(subtype), subtype);
 			status = ENOSYS;
 			break;
@@ -477,7 +705,7 @@ int Service(pid_t pid, Msg* msg)
 	} break;
 
 	default:
-		Log("unknown msg type %s (%#x)", MessageName(msg->type), msg->type);
+		Warn("unknown msg type %s (%#x)", MessageName(msg->type), msg->type);
 
 		status = ENOSYS;
 		break;
@@ -489,7 +717,7 @@ int Service(pid_t pid, Msg* msg)
 void ReplyMsg(pid_t pid, const void* msg, size_t size)
 {
 	if(Reply(pid, msg, size) == -1) {
-		Log("Reply() Reply(%d) failed: [%d] %s",
+		Warn("Reply() Reply(%d) failed: [%d] %s",
 			pid, errno, strerror(errno)
 			);
 	}
@@ -517,6 +745,9 @@ int Fstat(Ocb* ocb, pid_t pid)
 int Open(pid_t pid, int unit, int fd, int oflag, int mode)
 {
 	Ocb* ocb = 0;
+	int priority;
+	int uid;
+	int gid;
 
 	if(!Unit(unit))
 		return ENOENT;
@@ -524,10 +755,15 @@ int Open(pid_t pid, int unit, int fd, int oflag, int mode)
 	if((oflag&(O_CREAT|O_EXCL)) == (O_CREAT|O_EXCL))
 		return EEXIST;
 	
-	if(CheckPerms(pid, oflag, unit) != EOK)
+	FdGetInfo(pid, &priority, &uid, &gid);
+
+	if(CheckPerms(uid, gid, oflag, unit) != EOK)
 		return EPERM;
 
-	ocb = (Ocb*) malloc(sizeof(Ocb));
+	ocb = (Ocb*) PoolAlloc(&ocbPool);
+
+	if(!ocb)
+		return ENOMEM;
 
 	memset(ocb, '\0', sizeof(Ocb));
 
@@ -535,20 +771,53 @@ int Open(pid_t pid, int unit, int fd, int oflag, int mode)
 	ocb->unit	= unit;
 	ocb->oflag	= oflag;
 	ocb->mode	= mode;
+	ocb->pid	= pid;
+	ocb->priority	= priority;
 
 	// at the very least, Ocb must contain the RD, WR, and NONBLOCK state
 	if(!FdMap(pid, fd, ocb)) {
-		free(ocb);
+		PoolFree(&ocbPool, ocb);
 		return errno;
 	}
 
 	return EOK;
 }
+/*
+* Like Linux's random_write(), data written is mixed into the pool, but
+* not credited with any entropy.
+*/
 int Write(Ocb* ocb, pid_t pid, int nbytes, const char* data, int datasz)
 {
-	// I don't see a point to this, so its not implemented.
+	struct _io_write_reply reply;
+	char	buffer[BUFSIZ];
+	int		offset = min(nbytes, datasz);
+	int		n;
+
+	if((ocb->oflag & O_ACCMODE) == O_RDONLY)
+		return EBADF;
 
-	return ENOSYS;
+	add_random_bytes(data, offset, 0);
+
+	// the rest didn't fit in the message buffer
+	while(offset < nbytes) {
+		n = Readmsg(pid, offsetof(struct _io_write, data) + offset,
+				buffer, min(sizeof(buffer), nbytes - offset));
+
+		if(n <= 0)
+			break;
+
+		add_random_bytes(buffer, n, 0);
+		offset += n;
+	}
+	memset(buffer, 0, sizeof(buffer));
+
+	reply.status = EOK;
+	reply.zero = 0;
+	reply.nbytes = offset;
+
+	Reply(pid, &reply, sizeof(reply));
+
+	return -1;
 }
 /*
 * These implementations closely parallel the implementation of Linux's
@@ -564,6 +833,10 @@ void ReadUnblock(pid_t pid)
 
 	r = *rq;
 
+	// the signal may be for a client that isn't blocked in a read
+	if(!r)
+		return;
+
 	*rq = r->next;
 
 	if(r->reply.nbytes == 0)
@@ -571,50 +844,68 @@ void ReadUnblock(pid_t pid)
 
 	Reply(r->pid, &r->reply, sizeof(r->reply) - sizeof(r->reply.data));
 
-	free(r);
+	PoolFree(&readPool, r);
 }
-void DoReadQueue(void)
+/*
+* Transfer as much of a read as can be done now into the client's
+* reply buffer, updating the reply's nbytes and status.
+*/
+void ReadTransfer(pid_t pid, int unlimited, int nbytes,
+	struct _io_read_reply* reply)
 {
-	ReadRequest** rq = &readq;
+	char	entropy[BUFSIZ];
+	int		rdbytes = 0;
+	int		wrbytes = 0;
 
-	while(*rq)
-	{
-		// Linux makes this work like a pipe, i.e. you block until
-		// some data is available, not necessarily as much as you
-		// asked for.
+	while(reply->nbytes < nbytes) {
+		rdbytes = min(BUFSIZ, nbytes - reply->nbytes);
 
-		ReadRequest* r = *rq;
+		if(!unlimited)
+			rdbytes = min(get_random_size(), rdbytes);
 
-		char	entropy[BUFSIZ];
-		int		rdbytes = 0;
-		int		wrbytes = 0;
-		int		unlimited = Unit(r->ocb->unit)->unlimited;
+		if(rdbytes == 0)
+			break;
 
-		while(r->reply.nbytes < r->nbytes) {
-			rdbytes = min(BUFSIZ, r->nbytes - r->reply.nbytes);
+		if(unlimited)
+			get_urandom_bytes(entropy, rdbytes);
+		else
+			get_random_bytes(entropy, rdbytes);
 
-			if(!unlimited)
-				rdbytes = min(get_random_size(), rdbytes);
+		wrbytes = Writemsg(pid,
+			sizeof(*reply) - sizeof(reply->data) + reply->nbytes,
+			entropy, rdbytes);
 
-			if(rdbytes == 0)
-				break;
+		if(wrbytes == -1 && reply->nbytes == 0) {
+			reply->status = errno;
+			break;
+		}
 
-			get_random_bytes(entropy, rdbytes);
+		reply->nbytes += wrbytes;
 
-			wrbytes = Writemsg(r->pid,
-				sizeof(r->reply) - sizeof(r->reply.data) + r->reply.nbytes,
-				entropy, rdbytes);
+		if(wrbytes < rdbytes)
+			break;
+	}
 
-			if(wrbytes == -1 && r->reply.nbytes == 0) {
-				r->reply.status = errno;
-				break;
-			}
+	// the pool may now be low enough to wake entropy feeders
+	if(reply->nbytes > 0) {
+		SelectTrigger(UNIT_RANDOM, SEL_COND_OUTPUT);
+		SelectTrigger(UNIT_URANDOM, SEL_COND_OUTPUT);
+	}
+}
+void DoReadQueue(void)
+{
+	ReadRequest** rq = &readq;
 
-			r->reply.nbytes += wrbytes;
+	while(*rq)
+	{
+		// Linux makes this work like a pipe, i.e. you block until
+		// some data is available, not necessarily as much as you
+		// asked for.
 
-			if(wrbytes < rdbytes)
-				break;
-		}
+		ReadRequest* r = *rq;
+
+		ReadTransfer(r->pid, Unit(r->ocb->unit)->unlimited, r->nbytes,
+			&r->reply);
 
 		// set status to EAGAIN if no data was read, and status is ok,
 		// and non-blocking
@@ -635,11 +926,13 @@ void DoReadQueue(void)
 
 		*rq = r->next;
 
-		free(r);
+		PoolFree(&readPool, r);
 	}
 }
 int Read(Ocb* ocb, pid_t pid, int nbytes)
 {
+	int unlimited = Unit(ocb->unit)->unlimited;
+
 	// deal summarily with zero-length reads
 
 	if(nbytes == 0) {
@@ -649,9 +942,25 @@ int Read(Ocb* ocb, pid_t pid, int nbytes)
 		reply.zero = 0;
 		reply.nbytes = 0;
 
+		Reply(pid, &reply, sizeof(reply) - sizeof(reply.data));
+	} else if(unlimited || (ocb->oflag & O_NONBLOCK)
+				|| (!readq && get_random_size() > 0)) {
+		// Reads that won't block, and won't jump ahead of blocked
+		// readers, are done directly, without queueing.
+		struct _io_read_reply reply;
+
+		reply.status = EOK;
+		reply.zero = 0;
+		reply.nbytes = 0;
+
+		ReadTransfer(pid, unlimited, nbytes, &reply);
+
+		if(reply.nbytes == 0 && reply.status == EOK)
+			reply.status = EAGAIN;
+
 		Reply(pid, &reply, sizeof(reply) - sizeof(reply.data));
 	} else {
-		ReadRequest* r = malloc(sizeof(struct ReadRequest));
+		ReadRequest* r = (ReadRequest*) PoolAlloc(&readPool);
 
 		if(!r)
 			return ENOMEM;
@@ -682,10 +991,9 @@ int Select(pid_t pid, struct _io_select* msg)
 {
 	struct _io_select_reply* reply = 0;
 	int sz = 0;
-	int	armed = 0;
 	int i = 0;
 
-	Log("Select pid %d mode %#x proxy %d nfds %d\n",
+	Debug("Select pid %d mode %#x proxy %d nfds %d\n",
 		msg->pid, msg->mode, msg->proxy, msg->nfds);
 
 	// the msg and reply are identical sizes, so we can sizeof msg
@@ -715,22 +1023,28 @@ int Select(pid_t pid, struct _io_select* msg)
 
 		reply->set[i].flag |= _SEL_POLLED;
 
-		/* Never an exceptional condition and unwriteable... so lie
-		* and they'll find out what they want is impossible?
+		/* Never an exceptional condition... so lie and they'll find
+		* out what they want is impossible?
 		*/
 		if(reply->set[i].flag & _SEL_EXCEPT) {
 			reply->set[i].flag |= _SEL_IS_EXCEPT;
 			reply->nfds++;
 		}
 
+		/* Writeable when the pool is low, so feeders can sleep until
+		* the entropy they have to give is wanted.
+		*/
 		if(reply->set[i].flag & _SEL_OUTPUT) {
-			reply->set[i].flag |= _SEL_IS_OUTPUT;
-			reply->nfds++;
+			if(SelectReady(ocb->unit, SEL_COND_OUTPUT)) {
+				reply->set[i].flag |= _SEL_IS_OUTPUT;
+				reply->nfds++;
+			} else {
+				reply->set[i].flag &= ~_SEL_IS_OUTPUT;
+			}
 		}
 
 		if(reply->set[i].flag & _SEL_INPUT) {
-			Device *device = Unit(ocb->unit);
-			if(device->unlimited || (get_random_size() > 0)) {
+			if(SelectReady(ocb->unit, SEL_COND_INPUT)) {
 				reply->set[i].flag |= _SEL_IS_INPUT;
 				reply->nfds++;
 			} else {
@@ -743,8 +1057,17 @@ int Select(pid_t pid, struct _io_select* msg)
 			if(request & response) {
 				reply->set[i].flag &= ~_SEL_ARMED;
 			} else {
+				int e = EOK;
+
+				if(request & _SEL_INPUT)
+					e = SelectArm(pid, msg->proxy, ocb->unit, SEL_COND_INPUT);
+				if(e == EOK && (request & _SEL_OUTPUT))
+					e = SelectArm(pid, msg->proxy, ocb->unit, SEL_COND_OUTPUT);
+				if(e != EOK) {
+					SelectDisarm(pid);
+					return e;
+				}
 				reply->set[i].flag |= _SEL_ARMED;
-				armed++;
 			}
 		} else if(msg->mode & _SEL_POLL) {
 			reply->set[i].flag &= ~_SEL_ARMED;
@@ -753,12 +1076,6 @@ int Select(pid_t pid, struct _io_select* msg)
 
 	if(msg->mode & _SEL_POLL) {
 		SelectDisarm(pid);
-	} else if(msg->mode & _SEL_ARM) {
-		if(armed) {
-			int e = SelectArm(pid, msg->proxy);
-			if(e != EOK)
-				return e;
-		}
 	}
 
 	Reply(pid, reply, sz);
@@ -769,24 +1086,62 @@ int Select(pid_t pid, struct _io_select* msg)
 /*
 * fd <--> ocb Map
 *
-* This is a dumb fixed-size iplementation, good enough for now.
+* An fd is mapped to an index into ocbs_, which grows as needed. The
+* free indices are chained into a list through free_, so mapping and
+* unmapping an fd are O(1).
 */
 
-#define FDMAX 256
+#define FDSLOTS 64	/* initial size of ocbs_ */
 
 void*	ctrl_ = 0;
-Ocb*	ocbs_[FDMAX];
+Ocb**	ocbs_ = 0;
+int*	free_ = 0;	/* next free index, for the free indices */
+int		freelist_ = 0;	/* first free index, 0 when there are none */
+int		nslots_ = 0;
+
+int FdGrow()
+{
+	int		n = nslots_ ? 2 * nslots_ : FDSLOTS;
+	int		first = nslots_ ? nslots_ : 1;
+	Ocb**	ocbs = 0;
+	int*	nexts = 0;
+	int		i;
+
+	if(!(ocbs = (Ocb**) realloc(ocbs_, n * sizeof(Ocb*))))
+		return 0;
+	ocbs_ = ocbs;
+
+	if(!(nexts = (int*) realloc(free_, n * sizeof(int))))
+		return 0;
+	free_ = nexts;
+
+	// index 0 is never used, it means "unmapped"
+	ocbs_[0] = 0;
+	free_[0] = 0;
 
+	for(i = first; i < n; i++) {
+		ocbs_[i] = 0;
+		free_[i] = i + 1;
+	}
+	free_[n - 1] = freelist_;
+	freelist_ = first;
+	nslots_ = n;
+
+	return 1;
+}
 void FdInit()
 {
 	pid_t pid = getpid();
 	ctrl_ = __init_fd(pid);
+
+	if(!FdGrow())
+		Error("fd map init failed: [%d] %s\n", ERR(ENOMEM));
 }
 Ocb* FdGet(pid_t pid, int fd)
 {
 	int index = (int) __get_fd(pid, fd, ctrl_);
 
-	if(index <= 0 || index >= FDMAX) {
+	if(index <= 0 || index >= nslots_) {
 		errno = EBADF;
 		return 0;
 	}
@@ -798,65 +1153,71 @@ Ocb* FdGet(pid_t pid, int fd)
 }
 int FdMap(pid_t pid, int fd, Ocb* ocb)
 {
-	// index 0 is never used, it means "unmapped"
-	int index = 0;
+	int index = freelist_;
 
-	if(ocb)
-		ocb->links++;
-
-	if(ocb) {
-		index = 1;
-		while(ocbs_[index])
-			index++;
-	}
-	if(index >= FDMAX) {
-		errno = ENOMEM;
-		return 0;
+	if(!index) {
+		if(!FdGrow()) {
+			errno = ENOMEM;
+			return 0;
+		}
+		index = freelist_;
 	}
+
 	if(qnx_fd_attach(pid, fd, 0, 0, 0, 0, index) == -1) {
-		Log("qnx_fd_attach(pid %d fd %d) failed: [%d] %s",
+		Warn("qnx_fd_attach(pid %d fd %d) failed: [%d] %s",
 			pid, fd, ERR(errno));
 
-		if(ocb)
-			ocb->links--;
-
 		return 0;
 	}
 
+	freelist_ = free_[index];
+
 	ocbs_[index] = ocb;
 
-	if(ocb)
-		link_count++;
+	ocb->links++;
+
+	link_count++;
 
 	return 1;
 }
 int FdUnMap(pid_t pid, int fd)
 {
-	Ocb* ocb = FdGet(pid, fd);
+	int index = (int) __get_fd(pid, fd, ctrl_);
+	Ocb* ocb = 0;
 
-	if(!ocb)
+	if(index <= 0 || index >= nslots_ || !(ocb = ocbs_[index])) {
+		errno = EBADF;
 		return 0; // attempt by client to close a bad fd
+	}
 
 	// zero the mapping to invalidate the fd
-	if(!FdMap(pid, fd, 0))
+	if(qnx_fd_attach(pid, fd, 0, 0, 0, 0, 0) == -1) {
+		Warn("qnx_fd_attach(pid %d fd %d) failed: [%d] %s",
+			pid, fd, ERR(errno));
+
 		return 0;
+	}
+
+	ocbs_[index] = 0;
+	free_[index] = freelist_;
+	freelist_ = index;
 
 	ocb->links--;
 
 	link_count--;
 
 	if(ocb->links == 0)
-		free(ocb);
+		PoolFree(&ocbPool, ocb);
 
 	return 1;
 }
-void FdGetPrio(pid_t pid, int* priority)
+int FdGetPrio(pid_t pid)
 {
 	struct _psinfo3 psdata3;
 
 	__get_pid_info(pid, &psdata3, ctrl_);
 
-	*priority = psdata3.priority;
+	return psdata3.priority;
 }
 void FdGetIds(pid_t pid, int* uid, int* gid)
 {
@@ -867,6 +1228,16 @@ void FdGetIds(pid_t pid, int* uid, int* gid)
 	*uid = psdata3.euid;
 	*gid = psdata3.egid;
 }
+void FdGetInfo(pid_t pid, int* priority, int* uid, int* gid)
+{
+	struct _psinfo3 psdata3;
+
+	__get_pid_info(pid, &psdata3, ctrl_);
+
+	*priority = psdata3.priority;
+	*uid = psdata3.euid;
+	*gid = psdata3.egid;
+}
 
 const char* MessageName(msg_t type)
 {
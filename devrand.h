@@ -133,6 +133,14 @@ struct Ocb
 	int	unit;
 	int	oflag;
 	int	mode;
+
+	/*
+	 * the opening client's priority, cached to save a __get_pid_info()
+	 * per request from it, a dup'ed or inherited fd used by another
+	 * process has its priority looked up per queued read
+	 */
+	pid_t	pid;
+	int		priority;
 };
 
 typedef struct Ocb Ocb;
@@ -158,7 +166,15 @@ struct ArmedPid
 	pid_t	pid;
 	pid_t	proxy;
 
+	int		unit;
+	int		cond;
+
+	/* the unit's waiter list for cond, in the order armed */
 	struct ArmedPid* next;
+	struct ArmedPid* prev;
+
+	/* the pid index, so a pid can be disarmed without a search */
+	struct ArmedPid* pidnext;
 };
 
 typedef struct ArmedPid ArmedPid;
@@ -0,0 +1,54 @@
+/*
+* Fixed-size object pools.
+*
+* Objects are taken from the heap POOL_CHUNK at a time, and never given
+* back, a freed object goes on the pool's free-list for reuse. Once the
+* pool has grown to its high-water mark, allocation is a list pop.
+*/
+
+#include <stdlib.h>
+
+#include "util.h"
+#include "pool.h"
+
+#define POOL_CHUNK	16
+
+void* PoolAlloc(Pool* pool)
+{
+	void* obj = pool->free;
+
+	if(!obj) {
+		char* chunk = (char*) malloc(POOL_CHUNK * pool->size);
+		int i;
+
+		if(!chunk)
+			return 0;
+
+		for(i = 0; i < POOL_CHUNK; i++)
+			PoolFree(pool, chunk + i * pool->size);
+
+		pool->inuse += POOL_CHUNK;
+		pool->allocated += POOL_CHUNK;
+
+		obj = pool->free;
+	}
+
+	pool->free = *(void**) obj;
+
+	if(++pool->inuse > pool->highwater)
+		pool->highwater = pool->inuse;
+
+	return obj;
+}
+void PoolFree(Pool* pool, void* obj)
+{
+	*(void**) obj = pool->free;
+	pool->free = obj;
+	pool->inuse--;
+}
+void PoolLog(Pool* pool)
+{
+	Debug("pool %-12s in use %d, high-water %d, allocated %d",
+		pool->name, pool->inuse, pool->highwater, pool->allocated);
+}
+
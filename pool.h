@@ -0,0 +1,31 @@
+/**
+* Fixed-size object pools.
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+struct Pool
+{
+	const char*	name;
+	size_t		size;		// of the objects, at least a pointer
+	void*		free;		// free-list, threaded through the objects
+
+	int			inuse;
+	int			highwater;	// most objects ever in use at once
+	int			allocated;	// objects taken from the heap
+};
+
+typedef struct Pool Pool;
+
+#define POOL_INIT(NAME, TYPE) \
+	{ (NAME), sizeof(TYPE) < sizeof(void*) ? sizeof(void*) : sizeof(TYPE) }
+
+void*	PoolAlloc(Pool* pool);
+void	PoolFree(Pool* pool, void* obj);
+void	PoolLog(Pool* pool);
+
+#endif
+
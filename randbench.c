@@ -0,0 +1,773 @@
+//
+// randbench.c: load generator and latency benchmark for the drivers
+//
+// Copyright (c) 2000, Sam Roberts
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 1, or (at your option)
+//  any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+//  I can be contacted as sroberts@uniserve.com.
+//
+// Forks N clients that each make a random mix of operations on the
+// devices, and reports the throughput and latency of each kind of
+// operation. With -l, the clients are threads calling an in-process
+// stand-in for the resource manager instead of the devices, so the
+// harness runs where Dev.random and devc-random don't. They share one
+// pool under one mutex, as devc-random's threads do, so the numbers
+// include contention for it.
+//
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/select.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#if defined(__QNXNTO__) || defined(__linux__)
+#define LOCAL_THREADS
+#include <pthread.h>
+#endif
+
+#include "random.h"
+#include "util.h"
+
+char usage[] =
+	"Usage: %s [-hlf] [-n <clients>] [-c <count>] [-m <mix>]\n"
+	"          [-s <bytes>] [-S <bytes>] [-r <random>] [-u <urandom>]\n"
+	"          [-i <usecs>]\n"
+	"\n"
+	"  -h   print this helpful message\n"
+	"  -l   drive an in-process stand-in for the resource manager,\n"
+	"       from threads, instead of the devices\n"
+	"  -f   with -l, use fast key erasure output for urandom\n"
+	"  -n   concurrent clients, processes or with -l threads (default 4)\n"
+	"  -c   operations per client (default 10000)\n"
+	"  -m   mix of operations, as op:weight,... (default\n"
+	"       small:60,large:10,block:5,select:5,open:20), the ops are:\n"
+	"         small   read -s bytes from urandom\n"
+	"         large   read -S bytes from urandom\n"
+	"         block   read -s bytes from random, which may block\n"
+	"         select  wait up to a second for random to be readable\n"
+	"         open    open and close urandom\n"
+	"  -s   bytes in a small read (default 16)\n"
+	"  -S   bytes in a large read (default 4096)\n"
+	"  -r   random device (default /dev/random)\n"
+	"  -u   urandom device (default /dev/urandom)\n"
+	"  -i   with -l, microseconds between the stand-in's interrupts,\n"
+	"       which are all the entropy it gets (default 1000)\n"
+	;
+
+//
+// Operations
+//
+
+enum { OP_SMALL, OP_LARGE, OP_BLOCK, OP_SELECT, OP_OPEN, OPS };
+
+const char* opNames[OPS] = { "small", "large", "block", "select", "open" };
+
+int		opWeights[OPS] = { 60, 10, 5, 5, 20 };
+
+//
+// Latency histograms
+//
+// Latencies are counted in buckets of 1/16th of a power of 2 of ns, so
+// percentiles are within about 6%, and a client's results are a fixed
+// size and add up with the other clients'.
+//
+
+#define HIST_SUB		16
+#define HIST_BUCKETS	(HIST_SUB * 30)	// up to 2^33 ns, 8 seconds
+
+struct Hist
+{
+	unsigned long	count;
+	unsigned long	errors;
+	unsigned long	timeouts;	// waits that timed out, not in the latencies
+	unsigned long	max;		// ns
+	unsigned long	buckets[HIST_BUCKETS];
+};
+
+typedef struct Hist Hist;
+
+int HistBucket(unsigned long ns)
+{
+	int e = 0;
+	int b;
+
+	if(ns < HIST_SUB)
+		return ns;
+
+	while((ns >> e) >= 2 * HIST_SUB)
+		e++;
+
+	b = (e + 1) * HIST_SUB + (ns >> e) - HIST_SUB;
+
+	return b < HIST_BUCKETS ? b : HIST_BUCKETS - 1;
+}
+
+/*
+* The largest latency that falls in bucket b.
+*/
+unsigned long HistValue(int b)
+{
+	int e;
+
+	if(b < HIST_SUB)
+		return b;
+
+	e = b / HIST_SUB - 1;
+
+	return ((unsigned long) (b % HIST_SUB + HIST_SUB + 1) << e) - 1;
+}
+
+void HistAdd(Hist* h, unsigned long ns)
+{
+	h->count++;
+	h->buckets[HistBucket(ns)]++;
+	if(ns > h->max)
+		h->max = ns;
+}
+
+void HistMerge(Hist* to, const Hist* from)
+{
+	int b;
+
+	to->count += from->count;
+	to->errors += from->errors;
+	to->timeouts += from->timeouts;
+	if(from->max > to->max)
+		to->max = from->max;
+
+	for(b = 0; b < HIST_BUCKETS; b++)
+		to->buckets[b] += from->buckets[b];
+}
+
+/*
+* The latency, in ns, that fraction p of the operations took at most.
+*/
+unsigned long HistPercentile(const Hist* h, double p)
+{
+	unsigned long	want = (unsigned long) (p * h->count + 0.999999);
+	unsigned long	seen = 0;
+	int				b;
+
+	for(b = 0; b < HIST_BUCKETS; b++) {
+		seen += h->buckets[b];
+		if(seen >= want && seen > 0)
+			return min(HistValue(b), h->max);
+	}
+	return h->max;
+}
+
+//
+// Devices, the real ones, or the stand-in
+//
+
+struct Device
+{
+	int		(*open)(const char* path);
+	int		(*read)(int fd, void* buf, int nbytes);
+	int		(*wait)(int fd, int secs);	// 1 readable, 0 timed out, -1 error
+	int		(*close)(int fd);
+};
+
+typedef struct Device Device;
+
+char*	arg0;
+char*	randomPath = "/dev/random";
+char*	urandomPath = "/dev/urandom";
+long	irqInterval = 1000;
+int		output = RAND_OUT_EXTRACT;
+
+void Error(const char* format, ...)
+{
+	va_list al;
+	va_start(al, format);
+	fprintf(stderr, "%s: ", arg0);
+	vfprintf(stderr, format, al);
+	fprintf(stderr, "\n");
+	va_end(al);
+	exit(1);
+}
+
+double Now()
+{
+	struct timespec ts;
+
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+	clock_gettime(CLOCK_REALTIME, &ts);
+#endif
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int DevOpen(const char* path)
+{
+	return open(path, O_RDONLY);
+}
+int DevRead(int fd, void* buf, int nbytes)
+{
+	return read(fd, buf, nbytes);
+}
+int DevWait(int fd, int secs)
+{
+	fd_set			rfds;
+	struct timeval	tv;
+
+	FD_ZERO(&rfds);
+	FD_SET(fd, &rfds);
+	tv.tv_sec = secs;
+	tv.tv_usec = 0;
+
+	return select(fd + 1, &rfds, 0, 0, &tv);
+}
+int DevClose(int fd)
+{
+	return close(fd);
+}
+
+Device device = { DevOpen, DevRead, DevWait, DevClose };
+
+#ifdef LOCAL_THREADS
+
+/*
+* The stand-in does what devc-random's io handlers do with the pool.
+* An irq thread adds an interrupt every irqInterval, and wakes the
+* clients blocked in a read or a wait on random once it has input, as
+* IoMixed() does.
+*/
+
+#define LOCAL_IRQ		1
+#define LOCAL_RANDOM	0
+#define LOCAL_URANDOM	1
+#define LOCAL_FDS		1024
+
+struct LocalOcb
+{
+	int	unit;
+	int	oflag;
+};
+
+struct LocalOcb*	localFds[LOCAL_FDS];
+
+pthread_mutex_t		localMutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_cond_t		localInput = PTHREAD_COND_INITIALIZER;
+int					localDone;
+
+void* LocalIrq(void* arg)
+{
+	struct timespec ts;
+	int				ready;
+
+	ts.tv_sec = irqInterval / 1000000;
+	ts.tv_nsec = irqInterval % 1000000 * 1000;
+
+	for(;;) {
+		nanosleep(&ts, 0);
+
+		pthread_mutex_lock(&localMutex);
+		if(localDone) {
+			pthread_mutex_unlock(&localMutex);
+			break;
+		}
+		add_interrupt_randomness(LOCAL_IRQ);
+		ready = rand_input_ready();
+		pthread_mutex_unlock(&localMutex);
+
+		if(ready)
+			pthread_cond_broadcast(&localInput);
+	}
+	return 0;
+}
+
+int LocalOpen(const char* path)
+{
+	struct LocalOcb*	ocb;
+	int					fd;
+
+	if(strcmp(path, randomPath) && strcmp(path, urandomPath)) {
+		errno = ENOENT;
+		return -1;
+	}
+
+	ocb = (struct LocalOcb*) malloc(sizeof(*ocb));
+	if(!ocb) {
+		errno = ENOMEM;
+		return -1;
+	}
+	ocb->unit = strcmp(path, randomPath) ? LOCAL_URANDOM : LOCAL_RANDOM;
+	ocb->oflag = O_RDONLY;
+
+	pthread_mutex_lock(&localMutex);
+	for(fd = 0; fd < LOCAL_FDS && localFds[fd]; fd++)
+		;
+	if(fd < LOCAL_FDS)
+		localFds[fd] = ocb;
+	pthread_mutex_unlock(&localMutex);
+
+	if(fd == LOCAL_FDS) {
+		free(ocb);
+		errno = EMFILE;
+		return -1;
+	}
+	return fd;
+}
+int LocalRead(int fd, void* buf, int nbytes)
+{
+	struct LocalOcb* ocb;
+
+	pthread_mutex_lock(&localMutex);
+	ocb = localFds[fd];
+	if(ocb->unit == LOCAL_RANDOM) {
+		while(get_random_size() == 0)
+			pthread_cond_wait(&localInput, &localMutex);
+
+		nbytes = min(nbytes, get_random_size());
+		get_random_bytes(buf, nbytes);
+	}
+	else
+		get_urandom_bytes(buf, nbytes);
+	pthread_mutex_unlock(&localMutex);
+
+	return nbytes;
+}
+int LocalWait(int fd, int secs)
+{
+	struct timespec	end;
+	int				r = 1;
+
+	clock_gettime(CLOCK_REALTIME, &end);
+	end.tv_sec += secs;
+
+	pthread_mutex_lock(&localMutex);
+	while(!rand_input_ready()) {
+		if(pthread_cond_timedwait(&localInput, &localMutex, &end) == ETIMEDOUT) {
+			r = rand_input_ready();
+			break;
+		}
+	}
+	pthread_mutex_unlock(&localMutex);
+
+	return r;
+}
+int LocalClose(int fd)
+{
+	pthread_mutex_lock(&localMutex);
+	free(localFds[fd]);
+	localFds[fd] = 0;
+	pthread_mutex_unlock(&localMutex);
+
+	return 0;
+}
+
+Device local = { LocalOpen, LocalRead, LocalWait, LocalClose };
+
+#endif
+
+//
+// Clients
+//
+
+int		clients = 4;
+long	count = 10000;
+int		smallBytes = 16;
+int		largeBytes = 4096;
+
+/*
+* A client's choice of operations doesn't need to be unpredictable,
+* just different from the other clients'.
+*/
+unsigned Xorshift(unsigned* x)
+{
+	*x ^= *x << 13;
+	*x ^= *x >> 17;
+	*x ^= *x << 5;
+
+	return *x;
+}
+
+int PickOp(unsigned* x)
+{
+	int total = 0;
+	int pick;
+	int op;
+
+	for(op = 0; op < OPS; op++)
+		total += opWeights[op];
+
+	pick = Xorshift(x) % total;
+
+	for(op = 0; pick >= opWeights[op]; op++)
+		pick -= opWeights[op];
+
+	return op;
+}
+
+/*
+* Make client number id's operations, counting them in hists.
+*/
+void Client(int id, Hist* hists)
+{
+	char*	buf = (char*) malloc(largeBytes > smallBytes ? largeBytes : smallBytes);
+	unsigned x = (id + 1) * 2654435761u | 1;
+	int		rfd;
+	int		ufd;
+	long	i;
+
+	if(!buf)
+		Error("out of memory");
+
+	rfd = device.open(randomPath);
+	if(rfd == -1)
+		Error("open %s failed: %s", randomPath, strerror(errno));
+	ufd = device.open(urandomPath);
+	if(ufd == -1)
+		Error("open %s failed: %s", urandomPath, strerror(errno));
+
+	for(i = 0; i < count; i++) {
+		int		op = PickOp(&x);
+		double	start = Now();
+		double	ns;
+		int		r = -1;
+		int		tmp;
+
+		switch(op) {
+		case OP_SMALL:
+			r = device.read(ufd, buf, smallBytes);
+			break;
+		case OP_LARGE:
+			r = device.read(ufd, buf, largeBytes);
+			break;
+		case OP_BLOCK:
+			r = device.read(rfd, buf, smallBytes);
+			break;
+		case OP_SELECT:
+			r = device.wait(rfd, 1);
+			break;
+		case OP_OPEN:
+			r = tmp = device.open(urandomPath);
+			if(tmp != -1)
+				r = device.close(tmp);
+			break;
+		}
+
+		if(r == -1) {
+			hists[op].errors++;
+			continue;
+		}
+		// a second's timeout would swamp the wait times
+		if(op == OP_SELECT && r == 0) {
+			hists[op].timeouts++;
+			continue;
+		}
+		// fits in 32 bits
+		ns = (Now() - start) * 1e9;
+		HistAdd(&hists[op], ns < 4e9 ? (unsigned long) ns : 4000000000ul);
+	}
+
+	device.close(rfd);
+	device.close(ufd);
+	free(buf);
+}
+
+/*
+* Read a client's results, which may be bigger than a pipe's buffer.
+*/
+int ReadResults(int fd, Hist* hists)
+{
+	char*	p = (char*) hists;
+	int		got = 0;
+	int		r;
+
+	while(got < OPS * sizeof(Hist)) {
+		r = read(fd, p + got, OPS * sizeof(Hist) - got);
+		if(r <= 0)
+			return -1;
+		got += r;
+	}
+	return 0;
+}
+
+/*
+* Fork the clients, and add up their histograms in total.
+*/
+void RunForks(Hist* total)
+{
+	Hist	hists[OPS];
+	int*	fds;
+	pid_t*	pids;
+	int		op;
+	int		i;
+
+	fds = (int*) malloc(clients * sizeof(int));
+	pids = (pid_t*) malloc(clients * sizeof(pid_t));
+	if(!fds || !pids)
+		Error("out of memory");
+
+	for(i = 0; i < clients; i++) {
+		int p[2];
+
+		if(pipe(p) == -1)
+			Error("pipe failed: %s", strerror(errno));
+
+		pids[i] = fork();
+
+		if(pids[i] == -1)
+			Error("fork failed: %s", strerror(errno));
+
+		if(pids[i] == 0) {
+			close(p[0]);
+
+			memset(hists, 0, sizeof(hists));
+			Client(i, hists);
+
+			if(write(p[1], hists, sizeof(hists)) != sizeof(hists))
+				Error("results write failed: %s", strerror(errno));
+			exit(0);
+		}
+		close(p[1]);
+		fds[i] = p[0];
+	}
+
+	for(i = 0; i < clients; i++) {
+		int status;
+
+		if(ReadResults(fds[i], hists) == -1)
+			Error("client %d died without results", i);
+
+		for(op = 0; op < OPS; op++)
+			HistMerge(&total[op], &hists[op]);
+
+		close(fds[i]);
+		waitpid(pids[i], &status, 0);
+	}
+
+	free(fds);
+	free(pids);
+}
+
+#ifdef LOCAL_THREADS
+
+struct Thread
+{
+	pthread_t	tid;
+	int			id;
+	Hist		hists[OPS];
+};
+
+void* ThreadClient(void* arg)
+{
+	struct Thread* t = (struct Thread*) arg;
+
+	Client(t->id, t->hists);
+
+	return 0;
+}
+
+/*
+* Run the clients as threads calling the stand-in, with its irq thread,
+* and add up their histograms in total.
+*/
+void RunThreads(Hist* total)
+{
+	struct Thread*	threads;
+	pthread_t		irq;
+	int				e;
+	int				op;
+	int				i;
+
+	threads = (struct Thread*) calloc(clients, sizeof(*threads));
+	if(!threads)
+		Error("out of memory");
+
+	if((e = pthread_create(&irq, 0, LocalIrq, 0)) != 0)
+		Error("irq thread create failed: %s", strerror(e));
+
+	for(i = 0; i < clients; i++) {
+		threads[i].id = i;
+		e = pthread_create(&threads[i].tid, 0, ThreadClient, &threads[i]);
+		if(e != 0)
+			Error("client thread create failed: %s", strerror(e));
+	}
+	for(i = 0; i < clients; i++) {
+		pthread_join(threads[i].tid, 0);
+
+		for(op = 0; op < OPS; op++)
+			HistMerge(&total[op], &threads[i].hists[op]);
+	}
+
+	pthread_mutex_lock(&localMutex);
+	localDone = 1;
+	pthread_mutex_unlock(&localMutex);
+
+	pthread_join(irq, 0);
+
+	free(threads);
+}
+
+#endif
+
+void ParseMix(char* mix)
+{
+	char*	tok;
+	int		op;
+
+	memset(opWeights, 0, sizeof(opWeights));
+
+	for(tok = strtok(mix, ","); tok; tok = strtok(0, ",")) {
+		char* colon = strchr(tok, ':');
+
+		if(colon)
+			*colon = 0;
+
+		for(op = 0; op < OPS && strcmp(opNames[op], tok); op++)
+			;
+		if(op == OPS)
+			Error("unknown operation %s", tok);
+
+		opWeights[op] = colon ? atoi(colon + 1) : 1;
+	}
+
+	for(op = 0; op < OPS && !opWeights[op]; op++)
+		;
+	if(op == OPS)
+		Error("the mix has no operations in it");
+}
+
+int main(int argc, char* argv[])
+{
+	Hist	total[OPS];
+	int		standIn = 0;
+	double	start;
+	double	secs;
+	int		opt;
+	int		op;
+
+	arg0 = strrchr(argv[0], '/');
+	arg0 = arg0 ? arg0 + 1 : argv[0];
+
+	while((opt = getopt(argc, argv, "hlfn:c:m:s:S:r:u:i:")) != -1) {
+		switch(opt) {
+		case 'h':
+			printf(usage, arg0);
+			exit(0);
+
+		case 'l':
+			standIn = 1;
+			break;
+
+		case 'f':
+			output = RAND_OUT_FKE;
+			break;
+
+		case 'n':
+			clients = atoi(optarg);
+			break;
+
+		case 'c':
+			count = atol(optarg);
+			break;
+
+		case 'm':
+			ParseMix(optarg);
+			break;
+
+		case 's':
+			smallBytes = atoi(optarg);
+			break;
+
+		case 'S':
+			largeBytes = atoi(optarg);
+			break;
+
+		case 'r':
+			randomPath = optarg;
+			break;
+
+		case 'u':
+			urandomPath = optarg;
+			break;
+
+		case 'i':
+			irqInterval = atol(optarg);
+			break;
+
+		default:
+			fprintf(stderr, usage, arg0);
+			exit(1);
+		}
+	}
+
+	if(clients < 1)
+		clients = 1;
+	if(smallBytes < 1 || largeBytes < 1)
+		Error("read sizes must be at least 1 byte");
+
+	if(standIn) {
+#ifdef LOCAL_THREADS
+		device = local;
+		rand_initialize();
+		if(!rand_initialize_irq(LOCAL_IRQ))
+			Error("rand initialize irq %d failed", LOCAL_IRQ);
+		rand_set_output(output);
+#else
+		Error("-l needs threads, which this system doesn't have");
+#endif
+	}
+
+	memset(total, 0, sizeof(total));
+
+	start = Now();
+
+#ifdef LOCAL_THREADS
+	if(standIn)
+		RunThreads(total);
+	else
+#endif
+		RunForks(total);
+
+	secs = Now() - start;
+
+	printf("%d clients, %ld ops each, %s: %.3f s\n", clients, count,
+		standIn ? "in-process stand-in" : "devices", secs);
+	printf("%-7s %9s %6s %8s %10s %10s %10s %10s %10s\n",
+		"op", "count", "errors", "timeouts", "ops/s", "p50 us", "p99 us",
+		"p999 us", "max us");
+
+	for(op = 0; op < OPS; op++) {
+		Hist* h = &total[op];
+
+		if(!h->count && !h->errors && !h->timeouts)
+			continue;
+
+		printf("%-7s %9lu %6lu %8lu %10.0f %10.1f %10.1f %10.1f %10.1f\n",
+			opNames[op], h->count, h->errors, h->timeouts, h->count / secs,
+			HistPercentile(h, 0.50) / 1e3, HistPercentile(h, 0.99) / 1e3,
+			HistPercentile(h, 0.999) / 1e3, h->max / 1e3);
+	}
+
+	return 0;
+}
+
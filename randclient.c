@@ -0,0 +1,425 @@
+/*
+* librandclient, see randclient.h.
+*
+* A thread's generator is a ChaCha20 key. A refill runs RC_BLOCKS
+* blocks of it, the first 32 bytes of output become the next key and
+* the rest is handed out, being wiped as it goes, so neither the state
+* nor the buffer ever holds bytes that have been or will be seen by
+* more than one caller.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "randclient.h"
+#include "randd.h"
+
+#define RC_BLOCKS	16				// ChaCha20 blocks per refill
+#define RC_BUFSZ	(RC_BLOCKS * 64)
+#define RC_KEYSZ	32
+
+struct RandClient
+{
+	uint32_t		key[8];
+	unsigned char	buf[RC_BUFSZ];
+	size_t			avail;		// unused bytes at the end of buf
+
+	size_t			bytes;		// handed out since the last seed
+	time_t			seeded;		// when, 0 to seed before the next output
+	pid_t			pid;		// that seeded it
+	unsigned		forks;		// forkCount when it seeded
+};
+
+typedef struct RandClient RandClient;
+
+static const char*		source = RANDCLIENT_SOURCE;
+static size_t			budgetBytes = RANDCLIENT_BYTES;
+static unsigned			budgetSecs = RANDCLIENT_SECS;
+
+static pthread_once_t	once = PTHREAD_ONCE_INIT;
+static pthread_key_t	clientKey;
+
+// bumped in the child by pthread_atfork()
+static volatile unsigned		forkCount;
+// bumped with __sync_fetch_and_add(), threads seed at once
+static volatile unsigned long	seedCount;
+// ChaChaBlock() passed its known answer test
+static int						chachaOk;
+
+/*
+* ChaCha20, RFC 7539, with a 64 bit block counter and zero nonce. Each
+* key is only used for one refill, so the nonce is never needed.
+*/
+
+#define ROTL(v, n)	(((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QR(a, b, c, d) \
+	a += b; d ^= a; d = ROTL(d, 16); \
+	c += d; b ^= c; b = ROTL(b, 12); \
+	a += b; d ^= a; d = ROTL(d, 8); \
+	c += d; b ^= c; b = ROTL(b, 7)
+
+static void ChaChaBlock(const uint32_t key[8], uint32_t counter,
+	unsigned char out[64])
+{
+	uint32_t	in[16];
+	uint32_t	x[16];
+	int			i;
+
+	in[0] = 0x61707865;
+	in[1] = 0x3320646e;
+	in[2] = 0x79622d32;
+	in[3] = 0x6b206574;
+	for(i = 0; i < 8; i++)
+		in[4 + i] = key[i];
+	in[12] = counter;
+	in[13] = in[14] = in[15] = 0;
+
+	memcpy(x, in, sizeof(x));
+
+	for(i = 0; i < 10; i++) {
+		QR(x[0], x[4], x[8],  x[12]);
+		QR(x[1], x[5], x[9],  x[13]);
+		QR(x[2], x[6], x[10], x[14]);
+		QR(x[3], x[7], x[11], x[15]);
+		QR(x[0], x[5], x[10], x[15]);
+		QR(x[1], x[6], x[11], x[12]);
+		QR(x[2], x[7], x[8],  x[13]);
+		QR(x[3], x[4], x[9],  x[14]);
+	}
+
+	// little-endian output, whatever the host
+	for(i = 0; i < 16; i++) {
+		uint32_t v = x[i] + in[i];
+
+		out[4*i + 0] = v;
+		out[4*i + 1] = v >> 8;
+		out[4*i + 2] = v >> 16;
+		out[4*i + 3] = v >> 24;
+	}
+}
+
+/*
+* RFC 7539 A.1 test vectors 1 and 2, the all zero key and nonce, at
+* block counters 0 and 1.
+*/
+static const unsigned char chachaKat[2][64] = {
+	{
+		0x76, 0xb8, 0xe0, 0xad, 0xa0, 0xf1, 0x3d, 0x90,
+		0x40, 0x5d, 0x6a, 0xe5, 0x53, 0x86, 0xbd, 0x28,
+		0xbd, 0xd2, 0x19, 0xb8, 0xa0, 0x8d, 0xed, 0x1a,
+		0xa8, 0x36, 0xef, 0xcc, 0x8b, 0x77, 0x0d, 0xc7,
+		0xda, 0x41, 0x59, 0x7c, 0x51, 0x57, 0x48, 0x8d,
+		0x77, 0x24, 0xe0, 0x3f, 0xb8, 0xd8, 0x4a, 0x37,
+		0x6a, 0x43, 0xb8, 0xf4, 0x15, 0x18, 0xa1, 0x1c,
+		0xc3, 0x87, 0xb6, 0x69, 0xb2, 0xee, 0x65, 0x86,
+	},
+	{
+		0x9f, 0x07, 0xe7, 0xbe, 0x55, 0x51, 0x38, 0x7a,
+		0x98, 0xba, 0x97, 0x7c, 0x73, 0x2d, 0x08, 0x0d,
+		0xcb, 0x0f, 0x29, 0xa0, 0x48, 0xe3, 0x65, 0x69,
+		0x12, 0xc6, 0x53, 0x3e, 0x32, 0xee, 0x7a, 0xed,
+		0x29, 0xb7, 0x21, 0x76, 0x9c, 0xe6, 0x4e, 0x43,
+		0xd5, 0x71, 0x33, 0xb0, 0x74, 0xd8, 0x39, 0xd5,
+		0x31, 0xed, 0x1f, 0x28, 0x51, 0x0a, 0xfb, 0x45,
+		0xac, 0xe1, 0x0a, 0x1f, 0x4b, 0x79, 0x4d, 0x6f,
+	},
+};
+
+int rand_client_selftest(void)
+{
+	static const uint32_t	zero[8];
+	unsigned char			out[64];
+	uint32_t				i;
+
+	for(i = 0; i < 2; i++) {
+		ChaChaBlock(zero, i, out);
+		if(memcmp(out, chachaKat[i], sizeof(out)) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+* Read n bytes from randd's socket, with RANDD_READ requests.
+*/
+static int ReadSocket(const char* path, unsigned char* buf, size_t n)
+{
+	struct sockaddr_un		sun;
+	struct randd_request	req;
+	struct randd_reply		reply;
+	int						fd;
+	int						got = 0;
+	ssize_t					r;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1)
+		return -1;
+
+	if(connect(fd, (struct sockaddr*) &sun, sizeof(sun)) == -1)
+		goto fail;
+
+	memset(&req, 0, sizeof(req));
+	req.op = RANDD_READ;
+	req.len = n;
+
+	do
+		r = write(fd, &req, sizeof(req));
+	while(r == -1 && errno == EINTR);
+	if(r != sizeof(req))
+		goto fail;
+
+	while(got < sizeof(reply)) {
+		r = read(fd, (char*) &reply + got, sizeof(reply) - got);
+		if(r == -1 && errno == EINTR)
+			continue;
+		if(r <= 0)
+			goto fail;
+		got += r;
+	}
+	if(reply.status || reply.len != n) {
+		errno = reply.status ? reply.status : EIO;
+		goto fail;
+	}
+	for(got = 0; got < n; got += r) {
+		r = read(fd, buf + got, n - got);
+		if(r == -1 && errno == EINTR) {
+			r = 0;
+			continue;
+		}
+		if(r <= 0)
+			goto fail;
+	}
+
+	close(fd);
+	return 0;
+
+fail:
+	r = errno;
+	close(fd);
+	errno = r ? r : EIO;
+	return -1;
+}
+
+static int ReadDevice(const char* path, unsigned char* buf, size_t n)
+{
+	size_t	got;
+	ssize_t	r;
+	int		fd = open(path, O_RDONLY);
+
+	if(fd == -1)
+		return -1;
+
+	for(got = 0; got < n; got += r) {
+		r = read(fd, buf + got, n - got);
+		if(r == -1 && errno == EINTR) {
+			r = 0;
+			continue;
+		}
+		if(r <= 0) {
+			r = errno;
+			close(fd);
+			errno = r ? r : EIO;
+			return -1;
+		}
+	}
+	close(fd);
+	return 0;
+}
+
+/*
+* Mix a fresh seed from the driver into the key, and drop the buffer,
+* which came from the old one.
+*/
+static int Seed(RandClient* rc)
+{
+	unsigned char	seed[RC_KEYSZ];
+	struct stat		st;
+	int				i;
+	int				r;
+
+	if(stat(source, &st) == 0 && S_ISSOCK(st.st_mode))
+		r = ReadSocket(source, seed, sizeof(seed));
+	else
+		r = ReadDevice(source, seed, sizeof(seed));
+
+	if(r == -1)
+		return -1;
+
+	for(i = 0; i < 8; i++)
+		rc->key[i] ^= seed[4*i] | seed[4*i+1] << 8
+			| seed[4*i+2] << 16 | (uint32_t) seed[4*i+3] << 24;
+
+	memset(seed, 0, sizeof(seed));
+	memset(rc->buf, 0, sizeof(rc->buf));
+	rc->avail = 0;
+
+	rc->bytes = 0;
+	rc->seeded = time(0);
+	rc->pid = getpid();
+	rc->forks = forkCount;
+
+	__sync_fetch_and_add(&seedCount, 1);
+
+	return 0;
+}
+
+/*
+* Run the key forward a refill, taking the next key from the front of
+* the output.
+*/
+static void Refill(RandClient* rc)
+{
+	int i;
+
+	for(i = 0; i < RC_BLOCKS; i++)
+		ChaChaBlock(rc->key, i, rc->buf + 64 * i);
+
+	for(i = 0; i < 8; i++)
+		rc->key[i] = rc->buf[4*i] | rc->buf[4*i+1] << 8
+			| rc->buf[4*i+2] << 16 | (uint32_t) rc->buf[4*i+3] << 24;
+
+	memset(rc->buf, 0, RC_KEYSZ);
+	rc->avail = RC_BUFSZ - RC_KEYSZ;
+}
+
+/*
+* True when the generator has to reseed before it refills.
+*/
+static int Stale(RandClient* rc)
+{
+	if(!rc->seeded || rc->forks != forkCount)
+		return 1;
+
+	if(budgetBytes && rc->bytes >= budgetBytes)
+		return 1;
+
+	if(budgetSecs && time(0) - rc->seeded >= budgetSecs)
+		return 1;
+
+	// a fork that pthread_atfork() didn't see
+	return rc->pid != getpid();
+}
+
+static void Destroy(void* p)
+{
+	RandClient* rc = (RandClient*) p;
+
+	memset(rc, 0, sizeof(*rc));
+	free(rc);
+}
+
+static void AtFork()
+{
+	forkCount++;
+}
+
+static void Init()
+{
+	pthread_key_create(&clientKey, Destroy);
+	pthread_atfork(0, 0, AtFork);
+	chachaOk = rand_client_selftest() == 0;
+}
+
+static RandClient* Client()
+{
+	RandClient* rc;
+
+	pthread_once(&once, Init);
+
+	// don't hand out bytes from a miscompiled cipher
+	if(!chachaOk) {
+		errno = EIO;
+		return 0;
+	}
+
+	rc = (RandClient*) pthread_getspecific(clientKey);
+
+	if(!rc) {
+		rc = (RandClient*) calloc(1, sizeof(*rc));
+		if(!rc) {
+			errno = ENOMEM;
+			return 0;
+		}
+		pthread_setspecific(clientKey, rc);
+	}
+	return rc;
+}
+
+int rand_bytes(void* buf, size_t n)
+{
+	unsigned char*	out = (unsigned char*) buf;
+	RandClient*		rc = Client();
+
+	if(!rc)
+		return -1;
+
+	// bytes left over from before a fork are the parent's too
+	if(rc->forks != forkCount)
+		rc->avail = 0;
+
+	while(n > 0) {
+		unsigned char*	p;
+		size_t			sz;
+
+		if(rc->avail == 0) {
+			if(Stale(rc) && Seed(rc) == -1)
+				return -1;
+			Refill(rc);
+		}
+
+		sz = n < rc->avail ? n : rc->avail;
+		p = rc->buf + RC_BUFSZ - rc->avail;
+
+		memcpy(out, p, sz);
+		memset(p, 0, sz);
+
+		rc->avail -= sz;
+		rc->bytes += sz;
+		out += sz;
+		n -= sz;
+	}
+	return 0;
+}
+
+void rand_client_source(const char* path)
+{
+	source = path;
+}
+
+void rand_client_budget(size_t bytes, unsigned secs)
+{
+	budgetBytes = bytes;
+	budgetSecs = secs;
+}
+
+void rand_client_reseed(void)
+{
+	RandClient* rc = Client();
+
+	if(rc) {
+		memset(rc->buf, 0, sizeof(rc->buf));
+		rc->avail = 0;
+		rc->seeded = 0;
+	}
+}
+
+unsigned long rand_client_seeds(void)
+{
+	return seedCount;
+}
+
@@ -0,0 +1,59 @@
+/**
+* librandclient: random bytes without a driver round trip per call.
+*
+* Each thread keeps a ChaCha20 generator, keyed from the driver, and
+* hands out bytes from a buffer of its output. It rekeys itself from
+* its own output after every refill, so what it has handed out can't
+* be recovered from its state, and reseeds from the driver after a
+* budget of bytes or seconds, and in the child after a fork().
+*
+* Forks are caught with pthread_atfork(), and by the pid changing when
+* a reseed is due, a child made with a raw clone() or vfork() that
+* calls rand_bytes() before exec() isn't safe.
+*/
+
+#ifndef RANDCLIENT_H
+#define RANDCLIENT_H
+
+#include <stddef.h>
+
+#define RANDCLIENT_SOURCE	"/dev/urandom"
+#define RANDCLIENT_BYTES	(1024 * 1024)	/* default reseed budget */
+#define RANDCLIENT_SECS		300
+
+/*
+* Fill buf with n random bytes. Returns 0, or -1 with errno set if the
+* generator couldn't be seeded from the driver.
+*/
+int		rand_bytes(void* buf, size_t n);
+
+/*
+* Where seeds come from, a device like /dev/urandom, or randd's Unix
+* socket. Call before the first rand_bytes().
+*/
+void	rand_client_source(const char* path);
+
+/*
+* Reseed after this many bytes, or seconds, whichever comes first. 0
+* means no limit. Takes effect at each thread's next refill.
+*/
+void	rand_client_budget(size_t bytes, unsigned secs);
+
+/*
+* Make the calling thread's generator reseed before its next output.
+*/
+void	rand_client_reseed(void);
+
+/*
+* Check the ChaCha20 block function against the RFC 7539 test vectors.
+* Returns 0 if it passes. rand_bytes() fails with EIO if it doesn't.
+*/
+int		rand_client_selftest(void);
+
+/*
+* Times any thread in this process has seeded from the driver.
+*/
+unsigned long	rand_client_seeds(void);
+
+#endif
+
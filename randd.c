@@ -0,0 +1,1003 @@
+//
+// randd.c: random.c as a Linux daemon, serving randd.h's protocol on
+// a Unix socket
+//
+// Copyright (c) 2000, Sam Roberts
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 1, or (at your option)
+//  any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+//  I can be contacted as sroberts@uniserve.com.
+//
+
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#ifdef HAVE_NUMA
+#include <numa.h>
+#endif
+
+#include "util.h"
+#include "pool.h"
+#include "random.h"
+#include "randdserv.h"
+#include "seed.h"
+
+#define BLOCKED		-1	// Request() status, wait for entropy
+#define WAKE		-1	// on a handoff pipe, in place of an fd
+
+struct Loop		mainLoop;
+
+// with a loop per node, indexed by node, 0 for nodes without CPUs
+struct Loop**	loops;
+int				nodes;
+
+int			lfd;
+
+volatile int	terminate;
+
+void Terminate(int signo)
+{
+	terminate = signo;
+}
+
+void LoopInit(struct Loop* l, int node)
+{
+	Pool pool = POOL_INIT("Client", Client);
+
+	memset(l, 0, sizeof(*l));
+	l->node = node;
+	l->epfd = -1;
+	l->blockedTail = &l->blockedq;
+	l->clients = pool;
+	pthread_mutex_init(&l->fkeMutex, 0);
+
+	if(pipe2(l->handoff, O_NONBLOCK|O_CLOEXEC) == -1)
+		Error("pipe failed: [%d] %s", ERR(errno));
+}
+
+void Block(Client* c)
+{
+	struct Loop* l = c->loop;
+
+	c->blocked = 1;
+	c->next = 0;
+	*l->blockedTail = c;
+	l->blockedTail = &c->next;
+
+	l->stats.blocks++;
+}
+void Unblock(Client* c)
+{
+	struct Loop*	l = c->loop;
+	Client**		cp = &l->blockedq;
+
+	while(*cp && *cp != c)
+		cp = &(*cp)->next;
+
+	if(*cp) {
+		*cp = c->next;
+		if(!*cp)
+			l->blockedTail = cp;
+	}
+	c->blocked = 0;
+}
+
+/*
+* Set up a newly accepted client, served by loop l.
+*/
+void ClientInit(Client* c, struct Loop* l, int fd)
+{
+	struct ucred	cred;
+	socklen_t		credsz = sizeof(cred);
+
+	memset(c, 0, offsetof(Client, in));
+	c->loop = l;
+	c->fd = fd;
+	c->inlen = c->outlen = c->outoff = 0;
+	c->blocked = 0;
+	c->next = 0;
+
+	if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credsz) == 0) {
+		c->privileged = cred.uid == 0 || cred.uid == geteuid();
+
+		Debug("client fd %d pid %d uid %d%s", fd, cred.pid, cred.uid,
+			c->privileged ? ", privileged" : "");
+	}
+	l->stats.clients++;
+}
+
+/*
+* The reseeder, see randdserv.h. random.c's policy decides when a
+* reseed is due, this just checks every RESEED_POLL seconds.
+*/
+
+#define RESEED_POLL	1
+
+pthread_mutex_t		pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_mutex_t		key_mutex = PTHREAD_MUTEX_INITIALIZER;
+int					reseeding;
+
+/*
+* Seed each node's generator from an extract of its own, so no two
+* share a key.
+*/
+void SeedNodes()
+{
+	unsigned	seed[RAND_SEED_WORDS];
+	int			n;
+
+	for(n = 0; n < nodes; n++) {
+		struct Loop* l = loops[n];
+
+		if(!l)
+			continue;
+
+		PoolLock();
+		rand_reseed_extract(seed);
+		PoolUnlock();
+
+		FkeLock(l);
+		rand_fke_install(l->fke, seed);
+		FkeUnlock(l);
+	}
+	memset(seed, 0, sizeof(seed));
+}
+
+void* Reseeder(void* arg)
+{
+	unsigned	seed[RAND_SEED_WORDS];
+	int			due;
+	int			starved;
+
+	arg = arg;
+
+	while(1) {
+		sleep(RESEED_POLL);
+
+		PoolLock();
+		due = rand_reseed_due();
+		starved = rand_reseed_starved();
+		if(due)
+			rand_reseed_extract(seed);
+		PoolUnlock();
+
+		LogStarved(starved);
+
+		if(!due)
+			continue;
+
+		KeyLock();
+		rand_reseed_install(seed);
+		KeyUnlock();
+
+		memset(seed, 0, sizeof(seed));
+
+		SeedNodes();
+	}
+	return 0;
+}
+
+void StartReseeder()
+{
+	pthread_attr_t	attr;
+	pthread_t		tid;
+	sigset_t		set;
+	sigset_t		old;
+	int				e;
+
+	// the first seeds, before there are any readers
+	rand_reseed();
+	SeedNodes();
+	rand_reseed_schedule(1);
+	reseeding = 1;
+
+	// signals are the loop's to handle
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+	e = pthread_create(&tid, &attr, Reseeder, 0);
+
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+
+	if(e)
+		Error("pthread_create failed: [%d] %s\n", ERR(e));
+}
+
+void Reseeds(struct randd_reply* reply, char* out)
+{
+	struct rand_reseed_stats	st;
+	uint32_t					us[3];
+
+	KeyLock();
+	rand_get_reseed_stats(&st);
+	KeyUnlock();
+
+	us[0] = st.last_us;
+	us[1] = st.max_us;
+	us[2] = st.total_us;
+
+	reply->arg = st.count;
+	reply->len = sizeof(us);
+	memcpy(out, us, sizeof(us));
+}
+
+int InputReady()
+{
+	int ready;
+
+	PoolLock();
+	ready = rand_input_ready();
+	PoolUnlock();
+
+	return ready;
+}
+
+/*
+* Serve one request, appending its reply to the client's output.
+* Returns BLOCKED if it has to wait for entropy, else 0.
+*/
+int Request(Client* c, struct randd_request* req, const char* data)
+{
+	struct randd_reply	reply;
+	char*				out = c->out + c->outlen + sizeof(reply);
+
+	memset(&reply, 0, sizeof(reply));
+	reply.tag = req->tag;
+
+	switch(req->op) {
+	case RANDD_READ:
+		if(c->loop->fke) {
+			FkeLock(c->loop);
+			get_urandom_bytes_fke(c->loop->fke, out, req->len);
+			FkeUnlock(c->loop);
+		} else if(reseeding) {
+			KeyLock();
+			get_urandom_bytes(out, req->len);
+			KeyUnlock();
+		} else {
+			PoolLock();
+			get_urandom_bytes(out, req->len);
+			PoolUnlock();
+		}
+		reply.len = req->len;
+		break;
+
+	case RANDD_READ_BLOCK:
+		PoolLock();
+		reply.len = min(req->len, get_random_size());
+
+		if(reply.len == 0 && req->len > 0) {
+			PoolUnlock();
+			return BLOCKED;
+		}
+
+		get_random_bytes(out, reply.len);
+		PoolUnlock();
+		break;
+
+	case RANDD_GETENTCNT:
+		PoolLock();
+		reply.arg = rand_get_entcnt();
+		PoolUnlock();
+		break;
+
+	case RANDD_ADDENTROPY:
+		PoolLock();
+		add_random_bytes(data, req->len, c->privileged ? req->arg : 0);
+		PoolUnlock();
+		c->loop->added = 1;
+		break;
+
+	case RANDD_RESEEDS:
+		Reseeds(&reply, out);
+		break;
+
+	default:
+		reply.status = EINVAL;
+		break;
+	}
+
+	memcpy(c->out + c->outlen, &reply, sizeof(reply));
+	c->outlen += sizeof(reply) + reply.len;
+
+	return 0;
+}
+
+/*
+* Serve as many of the client's buffered requests as we can. Returns -1
+* if the client broke the protocol.
+*/
+int Serve(Client* c)
+{
+	struct randd_request	req;
+	int						need;
+
+	while(c->inlen >= sizeof(req)) {
+		memcpy(&req, c->in, sizeof(req));
+
+		if(req.len > RANDD_MAXDATA)
+			return -1;
+
+		need = sizeof(req) + (req.op == RANDD_ADDENTROPY ? req.len : 0);
+
+		if(c->inlen < need)
+			break;
+
+		// make room for the reply, or wait until the client reads
+		if(c->outoff > 0) {
+			memmove(c->out, c->out + c->outoff, c->outlen - c->outoff);
+			c->outlen -= c->outoff;
+			c->outoff = 0;
+		}
+		if(OUT_SIZE - c->outlen < sizeof(struct randd_reply) + RANDD_MAXDATA)
+			break;
+
+		logRequest = ++c->loop->stats.requests;
+
+		if(Request(c, &req, c->in + sizeof(req)) == BLOCKED) {
+			if(!c->blocked)
+				Block(c);
+			break;
+		}
+		if(c->blocked)
+			Unblock(c);
+
+		c->inlen -= need;
+		memmove(c->in, c->in + need, c->inlen);
+	}
+
+	return 0;
+}
+
+/*
+* A client closed while serving a batch of events may still have an
+* event later in the batch, so it's marked with an fd of -1, for the
+* batch to skip, and freed after it.
+*/
+void Close(Client* c)
+{
+	struct Loop* l = c->loop;
+
+	Debug("client fd %d closed", c->fd);
+
+	if(c->blocked)
+		Unblock(c);
+
+	epoll_ctl(l->epfd, EPOLL_CTL_DEL, c->fd, 0);
+	close(c->fd);
+
+	c->fd = -1;
+	c->next = l->closedq;
+	l->closedq = c;
+}
+
+void FreeClosed(struct Loop* l)
+{
+	while(l->closedq) {
+		Client* c = l->closedq;
+
+		l->closedq = c->next;
+		PoolFree(&l->clients, c);
+	}
+}
+
+/*
+* Write what replies we can, and watch for whatever the client can do
+* next. Returns -1 if the client has gone away.
+*/
+int Flush(Client* c)
+{
+	struct epoll_event	ev;
+	int					n;
+
+	while(c->outoff < c->outlen) {
+		n = write(c->fd, c->out + c->outoff, c->outlen - c->outoff);
+
+		if(n == -1) {
+			if(errno == EAGAIN || errno == EINTR)
+				break;
+			return -1;
+		}
+		c->outoff += n;
+	}
+	if(c->outoff == c->outlen)
+		c->outoff = c->outlen = 0;
+
+	ev.events = (c->inlen < IN_SIZE ? EPOLLIN : 0)
+		| (c->outoff < c->outlen ? EPOLLOUT : 0);
+	ev.data.ptr = c;
+
+	if(ev.events != c->events) {
+		if(epoll_ctl(c->loop->epfd, EPOLL_CTL_MOD, c->fd, &ev) == -1)
+			return -1;
+		c->events = ev.events;
+	}
+	return 0;
+}
+
+/*
+* Write the client's replies, and serve the requests it has buffered
+* behind them for as long as that makes room for more. Serve() stops
+* when the output is full, and a client with a full input buffer isn't
+* polled for input, so nothing else would serve them. Returns -1 if the
+* client has gone away.
+*/
+int Pump(Client* c)
+{
+	int inlen;
+
+	for(;;) {
+		if(Flush(c) == -1)
+			return -1;
+
+		if(c->blocked || c->inlen == 0)
+			return 0;
+		if(OUT_SIZE - (c->outlen - c->outoff)
+				< sizeof(struct randd_reply) + RANDD_MAXDATA)
+			return 0;
+
+		inlen = c->inlen;
+
+		if(Serve(c) == -1)
+			return -1;
+
+		// only a partial request left
+		if(c->inlen == inlen)
+			return 0;
+	}
+}
+
+/*
+* Serve blocked clients, in the order they blocked, while there's
+* entropy for them.
+*/
+void UnblockClients(struct Loop* l)
+{
+	while(l->blockedq && InputReady()) {
+		Client* c = l->blockedq;
+
+		if(Serve(c) == -1 || Pump(c) == -1) {
+			Close(c);
+			continue;
+		}
+		// still blocked, so the pool ran dry
+		if(c->blocked)
+			break;
+	}
+}
+
+/*
+* Start serving an accepted client on loop l.
+*/
+void Add(struct Loop* l, int fd)
+{
+	struct epoll_event	ev;
+	Client*				c = (Client*) PoolAlloc(&l->clients);
+
+	if(!c) {
+		Warn("client refused: [%d] %s", ERR(ENOMEM));
+		close(fd);
+		return;
+	}
+	ClientInit(c, l, fd);
+
+	ev.events = c->events = EPOLLIN;
+	ev.data.ptr = c;
+
+	if(epoll_ctl(l->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+		Warn("epoll_ctl add failed: [%d] %s", ERR(errno));
+		close(fd);
+		PoolFree(&l->clients, c);
+	}
+}
+
+#ifdef HAVE_NUMA
+/*
+* The CPU process pid last ran on, from /proc/pid/stat, or -1.
+*/
+int PidCpu(pid_t pid)
+{
+	char	path[64];
+	char	buf[1024];
+	char*	p;
+	int		field;
+	int		fd;
+	int		n;
+
+	snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+
+	if((fd = open(path, O_RDONLY|O_CLOEXEC)) == -1)
+		return -1;
+	n = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+
+	if(n <= 0)
+		return -1;
+	buf[n] = 0;
+
+	// the command name in field 2 may have spaces, so count from its end
+	p = strrchr(buf, ')');
+
+	for(field = 2; p && field < 39; field++) {
+		p = strchr(p + 1, ' ');
+	}
+	return p ? atoi(p + 1) : -1;
+}
+#endif
+
+/*
+* The loop for the node of the CPU the client on fd last ran on, or 0
+* if there's only the one loop, or the node can't be found.
+*/
+struct Loop* Route(int fd)
+{
+#ifdef HAVE_NUMA
+	struct ucred	cred;
+	socklen_t		credsz = sizeof(cred);
+	int				cpu;
+	int				node;
+
+	if(!loops)
+		return 0;
+
+	if(getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credsz) == -1)
+		return 0;
+	if((cpu = PidCpu(cred.pid)) == -1)
+		return 0;
+
+	node = numa_node_of_cpu(cpu);
+
+	if(node < 0 || node >= nodes)
+		return 0;
+	return loops[node];
+#else
+	fd = fd;
+	return 0;
+#endif
+}
+
+void Accept(struct Loop* l)
+{
+	struct Loop*	to;
+	int				fd;
+
+	while((fd = accept4(lfd, 0, 0, SOCK_NONBLOCK|SOCK_CLOEXEC)) != -1) {
+		to = Route(fd);
+
+		// if its pipe is full, the client's better served here than not
+		if(to && to != l
+				&& write(to->handoff[1], &fd, sizeof(fd)) == sizeof(fd))
+			continue;
+
+		Add(l, fd);
+	}
+	if(errno != EAGAIN && errno != EINTR) {
+		Warn("accept failed: [%d] %s", ERR(errno));
+	}
+}
+
+/*
+* Start serving the clients other loops have handed to l.
+*/
+void Handoff(struct Loop* l)
+{
+	int fds[64];
+	int n;
+	int i;
+
+	while((n = read(l->handoff[0], fds, sizeof(fds))) > 0) {
+		for(i = 0; i < n / sizeof(fds[0]); i++) {
+			if(fds[i] != WAKE)
+				Add(l, fds[i]);
+		}
+	}
+}
+
+/*
+* Wake the other loops, to serve their blocked clients, or to see
+* they've been told to terminate.
+*/
+void Wake(struct Loop* l)
+{
+	int wake = WAKE;
+	int n;
+
+	for(n = 0; n < nodes; n++) {
+		if(loops[n] && loops[n] != l)
+			write(loops[n]->handoff[1], &wake, sizeof(wake));
+	}
+}
+
+/*
+* Read what requests the client has sent, and serve them. Returns -1 if
+* the client has gone away.
+*/
+int Input(Client* c)
+{
+	int n = read(c->fd, c->in + c->inlen, IN_SIZE - c->inlen);
+
+	if(n == 0)
+		return -1;
+	if(n == -1)
+		return errno == EAGAIN || errno == EINTR ? 0 : -1;
+
+	c->inlen += n;
+
+	// it's blocked behind an earlier request, the new ones must wait
+	if(c->blocked)
+		return 0;
+
+	return Serve(c);
+}
+
+void Listen(const char* path)
+{
+	struct sockaddr_un	sun;
+
+	if(strlen(path) >= sizeof(sun.sun_path))
+		Error("socket path %s is too long", path);
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strcpy(sun.sun_path, path);
+
+	lfd = socket(AF_UNIX, SOCK_STREAM|SOCK_NONBLOCK|SOCK_CLOEXEC, 0);
+	if(lfd == -1)
+		Error("socket failed: [%d] %s", ERR(errno));
+
+	// a stale socket from an earlier run
+	unlink(path);
+
+	if(bind(lfd, (struct sockaddr*) &sun, sizeof(sun)) == -1)
+		Error("bind %s failed: [%d] %s", path, ERR(errno));
+
+	// like /dev/random, anyone can read and write
+	chmod(path, 0666);
+
+	if(listen(lfd, SOMAXCONN) == -1)
+		Error("listen failed: [%d] %s", ERR(errno));
+}
+
+#define EVENTS	64
+
+int Loop(struct Loop* l)
+{
+	struct epoll_event	events[EVENTS];
+	struct epoll_event	ev;
+	int					n;
+	int					i;
+
+	l->epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(l->epfd == -1)
+		Error("epoll_create failed: [%d] %s", ERR(errno));
+
+	// with a loop per node, only one is woken per connection
+	ev.events = EPOLLIN | (loops ? EPOLLEXCLUSIVE : 0);
+	ev.data.ptr = 0;
+
+	if(epoll_ctl(l->epfd, EPOLL_CTL_ADD, lfd, &ev) == -1)
+		Error("epoll_ctl failed: [%d] %s", ERR(errno));
+
+	ev.events = EPOLLIN;
+	ev.data.ptr = l->handoff;
+
+	if(epoll_ctl(l->epfd, EPOLL_CTL_ADD, l->handoff[0], &ev) == -1)
+		Error("epoll_ctl failed: [%d] %s", ERR(errno));
+
+	while(!terminate) {
+		if(l->primary)
+			LogPoll();
+
+		// wake up now and then to save the seed
+		n = epoll_wait(l->epfd, events, EVENTS, 1000);
+
+		if(n == -1) {
+			if(errno != EINTR) {
+				Warn("epoll_wait failed: [%d] %s", ERR(errno));
+			}
+			continue;
+		}
+
+		// the timing of our clients is the only source we have here,
+		// but it can be skipped rather than wait for a reseed
+		if(PoolTryLock()) {
+			SeedTick(options.seed);
+			if(n > 0)
+				add_interrupt_randomness(options.irq);
+			PoolUnlock();
+		}
+
+		for(i = 0; i < n; i++) {
+			Client* c = (Client*) events[i].data.ptr;
+
+			if(!c) {
+				Accept(l);
+				continue;
+			}
+			if(c == (Client*) l->handoff) {
+				Handoff(l);
+				continue;
+			}
+			if(c->fd == -1)
+				continue;
+			if((events[i].events & (EPOLLIN|EPOLLHUP|EPOLLERR))
+					&& Input(c) == -1) {
+				Close(c);
+				continue;
+			}
+			if(Pump(c) == -1) {
+				Close(c);
+				continue;
+			}
+		}
+
+		// clients may have added entropy, for those here or on other nodes
+		UnblockClients(l);
+
+		if(l->added) {
+			l->added = 0;
+			Wake(l);
+		}
+
+		FreeClosed(l);
+	}
+
+	return 0;
+}
+
+#ifdef HAVE_NUMA
+int NodeHasCpus(int node, struct bitmask* cpus)
+{
+	return numa_node_to_cpus(node, cpus) == 0 && numa_bitmask_weight(cpus) > 0;
+}
+
+/*
+* With -f, and more than one node with CPUs, make their loops, each
+* allocated on its node, with a generator of its own. Otherwise there's
+* just mainLoop, with random.c's generator.
+*/
+void NodesInit()
+{
+	struct bitmask*	cpus;
+	struct Loop*	l;
+	int				count = 0;
+	int				max;
+	int				n;
+
+	if(numa_available() == -1) {
+		Debug("numa: not available, serving from one loop");
+		return;
+	}
+	max = numa_max_node();
+	cpus = numa_allocate_cpumask();
+
+	for(n = 0; n <= max; n++) {
+		if(NodeHasCpus(n, cpus))
+			count++;
+	}
+	if(count < 2) {
+		Debug("numa: %d node, serving from one loop", count);
+		numa_free_cpumask(cpus);
+		return;
+	}
+
+	loops = (struct Loop**) calloc(max + 1, sizeof(*loops));
+	if(!loops)
+		Error("out of memory");
+
+	for(n = 0; n <= max; n++) {
+		if(!NodeHasCpus(n, cpus))
+			continue;
+
+		l = (struct Loop*) numa_alloc_onnode(sizeof(*l), n);
+		if(!l)
+			Error("numa_alloc_onnode %d failed", n);
+
+		LoopInit(l, n);
+		l->fke = &l->fkeState;
+		loops[n] = l;
+	}
+	nodes = max + 1;
+
+	numa_free_cpumask(cpus);
+
+	Debug("numa: %d nodes, serving from a loop on each", count);
+}
+
+void* NodeLoop(void* arg)
+{
+	struct Loop* l = (struct Loop*) arg;
+
+	if(numa_run_on_node(l->node) == -1) {
+		Warn("numa_run_on_node %d failed: [%d] %s", l->node, ERR(errno));
+	}
+	numa_set_localalloc();
+
+	Loop(l);
+
+	return 0;
+}
+
+/*
+* Run a loop per node, in a thread on the node, the first in the main
+* thread, until told to terminate.
+*/
+void NodesRun()
+{
+	struct Loop*	first = 0;
+	sigset_t		set;
+	sigset_t		old;
+	int				e;
+	int				n;
+
+	// signals are the main thread's to handle
+	sigfillset(&set);
+	pthread_sigmask(SIG_SETMASK, &set, &old);
+
+	for(n = 0; n < nodes; n++) {
+		if(!loops[n])
+			continue;
+		if(!first) {
+			first = loops[n];
+			continue;
+		}
+		if((e = pthread_create(&loops[n]->tid, 0, NodeLoop, loops[n])))
+			Error("pthread_create failed: [%d] %s\n", ERR(e));
+	}
+
+	pthread_sigmask(SIG_SETMASK, &old, 0);
+
+	first->primary = 1;
+	NodeLoop(first);
+
+	// the others only see terminate when they wake
+	Wake(first);
+
+	for(n = 0; n < nodes; n++) {
+		if(loops[n] && loops[n] != first)
+			pthread_join(loops[n]->tid, 0);
+	}
+}
+#endif
+
+/*
+* Log each loop's stats and pool, with a line for the total if there's a
+* loop per node.
+*/
+void LogLoops()
+{
+	struct Stats	total;
+	struct Loop*	l;
+	int				n;
+
+	memset(&total, 0, sizeof(total));
+
+	for(n = 0; n < (loops ? nodes : 1); n++) {
+		l = loops ? loops[n] : &mainLoop;
+
+		if(!l)
+			continue;
+
+		if(loops) {
+			Debug("node %d: requests %u, clients %u, blocked reads %u",
+				n, l->stats.requests, l->stats.clients, l->stats.blocks);
+		}
+
+		total.requests += l->stats.requests;
+		total.clients += l->stats.clients;
+		total.blocks += l->stats.blocks;
+
+		if(!options.uring)
+			PoolLog(&l->clients);
+	}
+
+	Debug("requests %u, clients %u, blocked reads %u",
+		total.requests, total.clients, total.blocks);
+}
+
+int main(int argc, char* argv[])
+{
+	const char* path;
+
+	StartupMark("start");
+
+	// our clients' timing is theirs to control, so it's only credited
+	// if -e asks for it, and -f's reseeds can't wait for credit
+	options.estimator = RAND_EST_NONE;
+	options.reseedBits = 0;
+
+	GetOpts(argc, argv);
+
+	path = options.socket ? options.socket : RANDD_SOCKET;
+
+	rand_initialize();
+	StartupMark("pool");
+
+	if(!rand_initialize_irq(options.irq))
+		Error("rand initialize source %d failed!\n", options.irq);
+	rand_set_estimator(options.irq, options.estimator);
+	rand_set_output(options.output);
+	rand_set_reseed_policy(options.reseedBits, options.reseedSecs);
+
+	Listen(path);
+	StartupMark("listen");
+
+	Daemonize();
+
+	signal(SIGTERM, Terminate);
+	signal(SIGINT, Terminate);
+	signal(SIGPIPE, SIG_IGN);
+
+	if(options.seed)
+		SeedLoad(options.seed, options.credit);
+	StartupMark("seed");
+
+	LoopInit(&mainLoop, 0);
+	mainLoop.primary = 1;
+
+#ifdef HAVE_NUMA
+	if(options.output == RAND_OUT_FKE && !options.uring)
+		NodesInit();
+#endif
+
+	// after the seed file, so it's in the generators' first keys
+	if(options.output == RAND_OUT_FKE)
+		StartReseeder();
+
+	LogCycles();
+
+	if(options.uring)
+		RingLoop();
+#ifdef HAVE_NUMA
+	else if(loops)
+		NodesRun();
+#endif
+	else
+		Loop(&mainLoop);
+
+	if(options.seed) {
+		PoolLock();
+		SeedSave(options.seed);
+		PoolUnlock();
+	}
+
+	unlink(path);
+
+	LogLoops();
+
+	KeyLock();
+	LogReseeds();
+	KeyUnlock();
+
+	return 0;
+}
+
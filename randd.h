@@ -0,0 +1,52 @@
+/**
+* randd's protocol.
+*
+* Requests and replies go over a Unix stream socket, each is a header
+* followed by len bytes of data. Requests can be pipelined, sent
+* without waiting for the replies to earlier ones, and the replies
+* come back in the order the requests were sent. All fields are in
+* host byte order, the socket is local.
+*/
+
+#ifndef RANDD_H
+#define RANDD_H
+
+#include <stdint.h>
+
+#define RANDD_SOCKET	"/run/randd.sock"
+
+// requests
+
+#define RANDD_READ			1	/* len bytes, never blocks (/dev/urandom) */
+#define RANDD_READ_BLOCK	2	/* 1 to len bytes, as many as the pool has
+								entropy for, blocks until it has some
+								(/dev/random) */
+#define RANDD_GETENTCNT		3	/* the entropy count in bits, in arg */
+#define RANDD_ADDENTROPY	4	/* mix in the len bytes of data, crediting
+								arg bits if the client is root or randd's
+								user, else none */
+#define RANDD_RESEEDS		5	/* the -f generator's reseed count in arg,
+								and as 3 uint32_t of data, the last,
+								longest and total time reseeds took, in
+								us */
+
+#define RANDD_MAXDATA		4096	/* the most data in a request or reply */
+
+struct randd_request
+{
+	uint32_t	op;		/* RANDD_* */
+	uint32_t	len;	/* bytes of data that follow, or wanted by a read */
+	uint32_t	arg;
+	uint32_t	tag;	/* the client's, returned in the reply */
+};
+
+struct randd_reply
+{
+	uint32_t	status;	/* 0, or an errno */
+	uint32_t	len;	/* bytes of data that follow */
+	uint32_t	arg;
+	uint32_t	tag;
+};
+
+#endif
+
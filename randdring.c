@@ -0,0 +1,725 @@
+//
+// randdring.c: randd's io_uring loop
+//
+// Copyright (c) 2000, Sam Roberts
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 1, or (at your option)
+//  any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+//  I can be contacted as sroberts@uniserve.com.
+//
+// The epoll loop makes a read(), a write(), and often an epoll_ctl()
+// per client per wakeup. This one makes one io_uring_enter() per
+// wakeup, for all clients:
+//
+// - the listening socket has a multishot accept, and each client a
+//   multishot recv, so they're armed once, not once per request
+// - the recvs take buffers from a ring of provided buffers, instead of
+//   each holding one
+// - the clients' reply buffers are registered with the ring, so
+//   replies are generated straight into registered buffers, and
+//   written with WRITE_FIXED without the kernel mapping them each time
+//
+// liburing isn't needed, this is written against the kernel's
+// <linux/io_uring.h>, which has to be from 6.0 or later.
+//
+
+#include <errno.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+
+#include <linux/io_uring.h>
+
+#include "util.h"
+#include "random.h"
+#include "randdserv.h"
+#include "seed.h"
+
+#ifdef IORING_RECV_MULTISHOT
+
+#define RING_ENTRIES	256		// submission queue
+#define RING_CQ_ENTRIES	4096	// completion queue, multishots can burst
+#define RING_CLIENTS	256		// clients in the registered table
+#define RING_BUFS		256		// provided recv buffers, a power of 2
+#define RING_BUFSZ		4096
+#define RING_BGID		0
+#define RING_HOLD		8		// most buffers a client holds before its
+								// recv is cancelled, see Hold()
+
+// what a completion is for, in the low bits of its user_data
+#define OP_ACCEPT	0
+#define OP_RECV		1
+#define OP_WRITE	2
+#define OP_CANCEL	3
+#define OP_BITS		2
+
+struct Held
+{
+	unsigned short	bid;
+	unsigned short	len;
+};
+
+struct RingClient
+{
+	Client	c;
+
+	int		inflight;	// ops the kernel still holds, can't free till 0
+	int		receiving;	// multishot recv armed
+	int		cancelled;	// and being cancelled, it holds enough
+	int		writing;
+	int		closing;
+	int		starved;	// recv ran out of buffers, rearm when there are some
+
+	// provided buffers received into but not yet copied into c.in
+	struct Held	held[RING_BUFS];
+	int		heldhead;
+	int		heldn;
+	int		heldoff;	// into the buffer at heldhead
+	int		heldbytes;	// not yet copied
+
+	struct RingClient*	free;
+};
+
+typedef struct RingClient RingClient;
+
+struct Ring
+{
+	int		fd;
+	int		nfixed;		// clients whose out buffers are registered
+
+	unsigned*	sqhead;
+	unsigned*	sqtail;
+	unsigned*	sqarray;
+	unsigned	sqmask;
+	unsigned	sqentries;
+	unsigned	sqlocal;	// our tail, published on Enter()
+	struct io_uring_sqe*	sqes;
+
+	unsigned*	cqhead;
+	unsigned*	cqtail;
+	unsigned	cqmask;
+	struct io_uring_cqe*	cqes;
+
+	struct io_uring_buf_ring*	br;
+	unsigned short				brtail;
+	char*						bufs;
+};
+
+static struct Ring	ring;
+
+static RingClient*	clients;
+static RingClient*	freeClients;
+static int			starved;
+
+static void Pump(RingClient* rc);
+
+static int Enter(unsigned submit, unsigned wait, unsigned flags,
+	void* arg, size_t argsz)
+{
+	return syscall(__NR_io_uring_enter, ring.fd, submit, wait, flags,
+		arg, argsz);
+}
+
+/*
+* Publish the queued submissions, and wait up to a second for at least
+* one completion. Returns -1 on error, with errno set.
+*/
+static int Submit()
+{
+	struct __kernel_timespec		ts = { 1, 0 };
+	struct io_uring_getevents_arg	arg;
+	unsigned						submit;
+	int								n;
+
+	memset(&arg, 0, sizeof(arg));
+	arg.ts = (unsigned long) &ts;
+
+	submit = ring.sqlocal - *ring.sqtail;
+	__atomic_store_n(ring.sqtail, ring.sqlocal, __ATOMIC_RELEASE);
+
+	n = Enter(submit, 1, IORING_ENTER_GETEVENTS|IORING_ENTER_EXT_ARG,
+		&arg, sizeof(arg));
+
+	if(n == -1 && errno == ETIME)
+		return 0;
+	return n;
+}
+
+static struct io_uring_sqe* Sqe(int op, int slot)
+{
+	struct io_uring_sqe*	sqe;
+	unsigned				idx;
+
+	// full, so submit what's queued without waiting
+	if(ring.sqlocal - __atomic_load_n(ring.sqhead, __ATOMIC_ACQUIRE)
+			== ring.sqentries) {
+		__atomic_store_n(ring.sqtail, ring.sqlocal, __ATOMIC_RELEASE);
+		if(Enter(ring.sqentries, 0, 0, 0, 0) == -1)
+			Error("io_uring_enter failed: [%d] %s", ERR(errno));
+	}
+
+	idx = ring.sqlocal++ & ring.sqmask;
+	sqe = &ring.sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->user_data = ((__u64) slot << OP_BITS) | op;
+
+	return sqe;
+}
+
+static void ArmAccept()
+{
+	struct io_uring_sqe* sqe = Sqe(OP_ACCEPT, 0);
+
+	sqe->opcode = IORING_OP_ACCEPT;
+	sqe->fd = lfd;
+	sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+	sqe->accept_flags = SOCK_CLOEXEC;
+}
+
+static void ArmRecv(RingClient* rc)
+{
+	struct io_uring_sqe* sqe = Sqe(OP_RECV, rc - clients);
+
+	sqe->opcode = IORING_OP_RECV;
+	sqe->fd = rc->c.fd;
+	sqe->ioprio = IORING_RECV_MULTISHOT;
+	sqe->flags = IOSQE_BUFFER_SELECT;
+	sqe->buf_group = RING_BGID;
+
+	rc->receiving = 1;
+	rc->inflight++;
+}
+
+static void Write(RingClient* rc)
+{
+	struct io_uring_sqe* sqe = Sqe(OP_WRITE, rc - clients);
+
+	int i = rc - clients;
+
+	sqe->opcode = i < ring.nfixed ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+	sqe->fd = rc->c.fd;
+	sqe->addr = (unsigned long) (rc->c.out + rc->c.outoff);
+	sqe->len = rc->c.outlen - rc->c.outoff;
+	sqe->off = (__u64) -1;
+	sqe->buf_index = i < ring.nfixed ? i : 0;
+
+	rc->writing = 1;
+	rc->inflight++;
+}
+
+static void CancelRecv(RingClient* rc)
+{
+	struct io_uring_sqe* sqe = Sqe(OP_CANCEL, rc - clients);
+
+	sqe->opcode = IORING_OP_ASYNC_CANCEL;
+	sqe->addr = ((__u64) (rc - clients) << OP_BITS) | OP_RECV;
+
+	rc->cancelled = 1;
+	rc->inflight++;
+}
+
+/*
+* Give a provided buffer back to the kernel.
+*/
+static void Recycle(unsigned short bid)
+{
+	struct io_uring_buf* buf = &ring.br->bufs[ring.brtail & (RING_BUFS - 1)];
+
+	buf->addr = (unsigned long) (ring.bufs + bid * RING_BUFSZ);
+	buf->len = RING_BUFSZ;
+	buf->bid = bid;
+
+	__atomic_store_n(&ring.br->tail, ++ring.brtail, __ATOMIC_RELEASE);
+}
+
+/*
+* Keep a buffer the client's recv filled until there's room in c.in.
+* The multishot recv stays armed while the client is blocked or its
+* replies are unread. So once it holds a request's worth, or
+* RING_HOLD buffers, the recv is cancelled, and Pump() rearms it when
+* they've been used. One client can then only take a few buffers.
+*/
+static void Hold(RingClient* rc, unsigned short bid, int len)
+{
+	struct Held* h = &rc->held[(rc->heldhead + rc->heldn++) % RING_BUFS];
+
+	h->bid = bid;
+	h->len = len;
+	rc->heldbytes += len;
+
+	if(rc->receiving && !rc->cancelled
+			&& (rc->heldbytes >= IN_SIZE || rc->heldn >= RING_HOLD))
+		CancelRecv(rc);
+}
+
+/*
+* Copy what held input fits into the client's request buffer.
+*/
+static void Fill(RingClient* rc)
+{
+	Client* c = &rc->c;
+
+	while(rc->heldn > 0 && c->inlen < IN_SIZE) {
+		struct Held*	h = &rc->held[rc->heldhead];
+		int				n = min(h->len - rc->heldoff, (int) IN_SIZE - c->inlen);
+
+		memcpy(c->in + c->inlen, ring.bufs + h->bid * RING_BUFSZ + rc->heldoff, n);
+		c->inlen += n;
+		rc->heldoff += n;
+		rc->heldbytes -= n;
+
+		if(rc->heldoff == h->len) {
+			Recycle(h->bid);
+			rc->heldhead = (rc->heldhead + 1) % RING_BUFS;
+			rc->heldn--;
+			rc->heldoff = 0;
+		}
+	}
+}
+
+static RingClient* Alloc(int fd)
+{
+	RingClient* rc = freeClients;
+
+	if(!rc)
+		return 0;
+
+	freeClients = rc->free;
+
+	ClientInit(&rc->c, &mainLoop, fd);
+	rc->inflight = rc->receiving = rc->writing = rc->closing = 0;
+	rc->cancelled = rc->starved = 0;
+	rc->heldhead = rc->heldn = rc->heldoff = rc->heldbytes = 0;
+
+	return rc;
+}
+
+static void Free(RingClient* rc);
+
+/*
+* Start closing a client. It's freed when the kernel's done with it:
+* now, if nothing is in flight, or else at its last completion.
+*/
+static void Shut(RingClient* rc)
+{
+	if(rc->closing)
+		return;
+
+	Debug("client fd %d closed", rc->c.fd);
+
+	rc->closing = 1;
+
+	if(rc->c.blocked)
+		Unblock(&rc->c);
+
+	// completes the multishot recv, and any write
+	shutdown(rc->c.fd, SHUT_RDWR);
+
+	if(rc->inflight == 0)
+		Free(rc);
+}
+
+/*
+* Put a closed client back in the table, its fd is -1 till it's reused.
+*/
+static void Free(RingClient* rc)
+{
+	if(rc->starved) {
+		rc->starved = 0;
+		starved--;
+	}
+	while(rc->heldn > 0) {
+		Recycle(rc->held[rc->heldhead].bid);
+		rc->heldhead = (rc->heldhead + 1) % RING_BUFS;
+		rc->heldn--;
+	}
+
+	close(rc->c.fd);
+	rc->c.fd = -1;
+	rc->heldoff = rc->heldbytes = 0;
+
+	rc->free = freeClients;
+	freeClients = rc;
+}
+
+/*
+* Serve what the client has sent, write the replies, and keep its recv
+* armed. Only one write is in flight per client, and requests are only
+* served between writes, because Serve() moves the unwritten replies.
+*/
+static void Pump(RingClient* rc)
+{
+	Client* c = &rc->c;
+
+	if(rc->closing)
+		return;
+
+	if(!rc->writing) {
+		int inlen = -1;
+
+		// only the first blocked client takes the entropy that arrives
+		while(c->inlen != inlen
+			&& (!c->blocked || (mainLoop.blockedq == c && InputReady()))) {
+
+			Fill(rc);
+			inlen = c->inlen;
+
+			if(Serve(c) == -1) {
+				Shut(rc);
+				return;
+			}
+			if(c->blocked)
+				break;
+		}
+		Fill(rc);
+
+		if(c->outoff < c->outlen)
+			Write(rc);
+	}
+
+	// holding buffers, it waits to take more till it's used them, see
+	// Hold()
+	if(!rc->receiving && !rc->starved && rc->heldn == 0)
+		ArmRecv(rc);
+}
+
+/*
+* Rearm the recvs that ran out of buffers, now that some are back.
+*/
+static void Unstarve()
+{
+	int i;
+
+	for(i = 0; starved > 0 && i < RING_CLIENTS; i++) {
+		if(clients[i].starved) {
+			clients[i].starved = 0;
+			starved--;
+			Pump(&clients[i]);
+		}
+	}
+}
+
+static void UnblockClients()
+{
+	while(mainLoop.blockedq && InputReady()) {
+		RingClient* rc = (RingClient*) mainLoop.blockedq;
+
+		// its write completion will serve it
+		if(rc->writing)
+			break;
+
+		Pump(rc);
+
+		if(mainLoop.blockedq == &rc->c)
+			break;
+	}
+}
+
+static void Complete(struct io_uring_cqe* cqe)
+{
+	int				op = cqe->user_data & ((1 << OP_BITS) - 1);
+	RingClient*		rc = &clients[cqe->user_data >> OP_BITS];
+	int				more = cqe->flags & IORING_CQE_F_MORE;
+
+	switch(op) {
+	case OP_ACCEPT:
+		if(cqe->res >= 0) {
+			RingClient* nc = Alloc(cqe->res);
+
+			if(nc)
+				Pump(nc);
+			else {
+				Warn("client refused: [%d] %s", ERR(ENOMEM));
+				close(cqe->res);
+			}
+		}
+		else if(!terminate) {
+			Warn("accept failed: [%d] %s", ERR(-cqe->res));
+		}
+		if(!more)
+			ArmAccept();
+		return;
+
+	case OP_RECV:
+		if(cqe->flags & IORING_CQE_F_BUFFER) {
+			unsigned short bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+			if(cqe->res > 0 && !rc->closing)
+				Hold(rc, bid, cqe->res);
+			else
+				Recycle(bid);
+		}
+		if(!more) {
+			rc->receiving = 0;
+			rc->cancelled = 0;
+			rc->inflight--;
+		}
+		if(cqe->res == -ENOBUFS && !rc->closing) {
+			rc->starved = 1;
+			starved++;
+		}
+		// a cancelled recv is rearmed by Pump()
+		if(cqe->res == 0 || (cqe->res < 0 && cqe->res != -ENOBUFS
+				&& cqe->res != -ECANCELED))
+			Shut(rc);
+		break;
+
+	case OP_CANCEL:
+		// the recv's own completion says how it ended
+		rc->inflight--;
+		break;
+
+	case OP_WRITE:
+		rc->writing = 0;
+		rc->inflight--;
+
+		if(cqe->res < 0) {
+			Shut(rc);
+			break;
+		}
+		rc->c.outoff += cqe->res;
+		if(rc->c.outoff == rc->c.outlen)
+			rc->c.outoff = rc->c.outlen = 0;
+		break;
+	}
+
+	if(rc->closing) {
+		// unless Shut() found nothing in flight and freed it already
+		if(rc->inflight == 0 && rc->c.fd != -1)
+			Free(rc);
+		return;
+	}
+	Pump(rc);
+}
+
+static void* Map(size_t sz, off_t off)
+{
+	void* p = mmap(0, sz, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE,
+		ring.fd, off);
+
+	if(p == MAP_FAILED)
+		Error("io_uring mmap failed: [%d] %s", ERR(errno));
+
+	return p;
+}
+
+/*
+* Register each client's out buffer, as buffer index = its slot, so its
+* replies can be written with WRITE_FIXED. Registered buffers are
+* pinned, and count against RLIMIT_MEMLOCK, which is often only a few MB
+* or less for a user, so if the kernel refuses all of them, half as
+* many are tried, and the clients past the ones that fit write plainly.
+*/
+static void RegisterBuffers()
+{
+	struct iovec*	iov;
+	int				r = -1;
+	int				e = 0;
+	int				n;
+	int				i;
+
+	iov = (struct iovec*) malloc(RING_CLIENTS * sizeof(*iov));
+	if(!iov)
+		Error("io_uring buffer registration failed: [%d] %s", ERR(ENOMEM));
+
+	for(i = 0; i < RING_CLIENTS; i++) {
+		iov[i].iov_base = clients[i].c.out;
+		iov[i].iov_len = OUT_SIZE;
+	}
+
+	for(n = RING_CLIENTS; n > 0; n /= 2) {
+		r = syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_BUFFERS,
+			iov, n);
+		e = errno;
+		if(r == 0 || e != ENOMEM)
+			break;
+	}
+	free(iov);
+
+	ring.nfixed = r == 0 ? n : 0;
+
+	if(ring.nfixed == 0) {
+		Warn("io_uring buffer registration failed, writes won't be fixed:"
+			" [%d] %s", ERR(e));
+	} else if(ring.nfixed < RING_CLIENTS) {
+		Warn("io_uring buffers for only %d of %d clients fit in"
+			" RLIMIT_MEMLOCK, the rest won't write fixed",
+			ring.nfixed, RING_CLIENTS);
+	}
+}
+
+static void RingInit()
+{
+	struct io_uring_params	p;
+	struct io_uring_buf_reg	reg;
+	size_t					sqsz;
+	size_t					cqsz;
+	char*					sq;
+	char*					cq;
+	size_t					sz;
+	int						i;
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_CQSIZE
+		| IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN;
+	p.cq_entries = RING_CQ_ENTRIES;
+
+	ring.fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+
+	// kernels before 6.1 don't know the last two
+	if(ring.fd == -1 && errno == EINVAL) {
+		p.flags = IORING_SETUP_CQSIZE;
+		ring.fd = syscall(__NR_io_uring_setup, RING_ENTRIES, &p);
+	}
+	if(ring.fd == -1)
+		Error("io_uring_setup failed: [%d] %s", ERR(errno));
+
+	if(!(p.features & IORING_FEAT_SINGLE_MMAP)
+			|| !(p.features & IORING_FEAT_EXT_ARG))
+		Error("io_uring is too old, needs 5.11 or later");
+
+	sqsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+	sq = cq = (char*) Map(sqsz > cqsz ? sqsz : cqsz, IORING_OFF_SQ_RING);
+
+	ring.sqhead = (unsigned*) (sq + p.sq_off.head);
+	ring.sqtail = (unsigned*) (sq + p.sq_off.tail);
+	ring.sqarray = (unsigned*) (sq + p.sq_off.array);
+	ring.sqmask = *(unsigned*) (sq + p.sq_off.ring_mask);
+	ring.sqentries = p.sq_entries;
+	ring.sqlocal = *ring.sqtail;
+	ring.sqes = (struct io_uring_sqe*) Map(
+		p.sq_entries * sizeof(struct io_uring_sqe), IORING_OFF_SQES);
+
+	// sqes are used in order, so the indirection is fixed
+	for(i = 0; i < p.sq_entries; i++)
+		ring.sqarray[i] = i;
+
+	ring.cqhead = (unsigned*) (cq + p.cq_off.head);
+	ring.cqtail = (unsigned*) (cq + p.cq_off.tail);
+	ring.cqmask = *(unsigned*) (cq + p.cq_off.ring_mask);
+	ring.cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+	// the client table, whose reply buffers are registered
+	sz = RING_CLIENTS * sizeof(RingClient);
+	clients = (RingClient*) mmap(0, sz, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	if(clients == MAP_FAILED)
+		Error("client table mmap failed: [%d] %s", ERR(errno));
+
+	for(i = RING_CLIENTS - 1; i >= 0; i--) {
+		clients[i].free = freeClients;
+		freeClients = &clients[i];
+	}
+
+	RegisterBuffers();
+
+	// the provided recv buffers
+	sz = RING_BUFS * sizeof(struct io_uring_buf);
+	ring.br = (struct io_uring_buf_ring*) mmap(0, sz, PROT_READ|PROT_WRITE,
+		MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+	ring.bufs = (char*) malloc(RING_BUFS * RING_BUFSZ);
+	if(ring.br == MAP_FAILED || !ring.bufs)
+		Error("recv buffer allocation failed: [%d] %s", ERR(ENOMEM));
+
+	memset(&reg, 0, sizeof(reg));
+	reg.ring_addr = (unsigned long) ring.br;
+	reg.ring_entries = RING_BUFS;
+	reg.bgid = RING_BGID;
+
+	if(syscall(__NR_io_uring_register, ring.fd, IORING_REGISTER_PBUF_RING,
+			&reg, 1) == -1)
+		Error("io_uring provided buffers failed: [%d] %s", ERR(errno));
+
+	for(i = 0; i < RING_BUFS; i++)
+		Recycle(i);
+
+	Debug("io_uring sq %u cq %u, clients %d, recv buffers %d of %d",
+		p.sq_entries, p.cq_entries, RING_CLIENTS, RING_BUFS, RING_BUFSZ);
+}
+
+int RingLoop()
+{
+	unsigned		head;
+	unsigned		tail;
+	unsigned short	brtail;
+	int				n;
+
+	RingInit();
+
+	ArmAccept();
+
+	while(!terminate) {
+		LogPoll();
+
+		// wakes up now and then to save the seed
+		n = Submit();
+
+		if(n == -1) {
+			if(errno != EINTR) {
+				Warn("io_uring_enter failed: [%d] %s", ERR(errno));
+			}
+			continue;
+		}
+
+		head = *ring.cqhead;
+		tail = __atomic_load_n(ring.cqtail, __ATOMIC_ACQUIRE);
+
+		// the timing of our clients is the only source we have here,
+		// but it can be skipped rather than wait for a reseed
+		if(PoolTryLock()) {
+			SeedTick(options.seed);
+			if(head != tail)
+				add_interrupt_randomness(options.irq);
+			PoolUnlock();
+		}
+
+		brtail = ring.brtail;
+
+		for(; head != tail; head++)
+			Complete(&ring.cqes[head & ring.cqmask]);
+
+		__atomic_store_n(ring.cqhead, head, __ATOMIC_RELEASE);
+
+		if(starved && brtail != ring.brtail)
+			Unstarve();
+
+		// a client may have added entropy
+		UnblockClients();
+	}
+
+	return 0;
+}
+
+#else
+
+int RingLoop()
+{
+	Error("io_uring support needs <linux/io_uring.h> from Linux 6.0 or later");
+	return -1;
+}
+
+#endif
+
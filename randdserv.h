@@ -0,0 +1,139 @@
+//
+// randdserv.h: randd's clients, shared by its epoll and io_uring loops
+//
+// Copyright (c) 2000, Sam Roberts
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 1, or (at your option)
+//  any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+//  I can be contacted as sroberts@uniserve.com.
+//
+
+#ifndef RANDDSERV_H
+#define RANDDSERV_H
+
+#include <pthread.h>
+
+#include "pool.h"
+#include "random.h"
+#include "randd.h"
+
+//
+// Each client has a buffer for requests read, and one for replies not
+// yet written. Requests are served in order, and serving stops when one
+// has to block for entropy, or when there isn't room for its reply, so
+// a client that pipelines requests faster than it reads the replies
+// can't make us buffer without limit.
+//
+
+#define IN_SIZE		(sizeof(struct randd_request) + RANDD_MAXDATA)
+#define OUT_SIZE	(8 * (sizeof(struct randd_reply) + RANDD_MAXDATA))
+
+struct Loop;
+
+struct Client
+{
+	struct Loop*	loop;	// serving it
+	int		fd;
+	int		privileged;	// may credit the entropy it adds
+	int		events;		// that epoll is watching for
+
+	char	in[IN_SIZE];
+	int		inlen;
+
+	char	out[OUT_SIZE];
+	int		outlen;
+	int		outoff;
+
+	// clients waiting for entropy, in the order they blocked
+	int		blocked;
+	struct Client*	next;
+};
+
+typedef struct Client Client;
+
+struct Stats
+{
+	unsigned	requests;
+	unsigned	clients;
+	unsigned	blocks;
+};
+
+//
+// With -f, a thread reseeds the generator from the pool when it's due,
+// so the pool is shared with it and random.c calls are made with it
+// locked. Reads only use the generator's key, which has its own lock,
+// so they don't wait while the pool is hashed. Anything needing both
+// takes the pool first.
+//
+
+extern pthread_mutex_t	pool_mutex;
+extern pthread_mutex_t	key_mutex;
+extern int				reseeding;
+
+#define PoolLock()		pthread_mutex_lock(&pool_mutex)
+#define PoolUnlock()	pthread_mutex_unlock(&pool_mutex)
+#define PoolTryLock()	(pthread_mutex_trylock(&pool_mutex) == 0)
+#define KeyLock()		pthread_mutex_lock(&key_mutex)
+#define KeyUnlock()		pthread_mutex_unlock(&key_mutex)
+
+//
+// A loop serving clients. There's one, mainLoop, unless randd is built
+// with libnuma and runs with -f on a host with more than one NUMA node.
+// Then there's one per node, allocated on it, in a thread that runs on
+// it, with a generator of its own, so readers on different nodes never
+// share its key's cache lines. The reseeder seeds each from its own
+// extract of the pool when it reseeds random.c's. Whichever loop accepts
+// a client hands it to the loop for the node of the CPU the client last
+// ran on.
+//
+
+struct Loop
+{
+	int			node;
+	int			primary;	// in the main thread, which takes the signals
+	pthread_t	tid;
+	int			epfd;
+	int			handoff[2];	// fds of clients from other loops' accepts
+
+	Client*		blockedq;	// clients waiting for entropy, in the order they blocked
+	Client**	blockedTail;
+	Client*		closedq;	// see Close()
+	int			added;		// a client added entropy, wake the other loops
+
+	Pool			clients;
+	struct Stats	stats;
+
+	// the node's generator, or 0 for random.c's, under key_mutex
+	struct rand_fke*	fke;
+	pthread_mutex_t		fkeMutex;
+	struct rand_fke		fkeState;
+};
+
+#define FkeLock(l)		pthread_mutex_lock(&(l)->fkeMutex)
+#define FkeUnlock(l)	pthread_mutex_unlock(&(l)->fkeMutex)
+
+extern struct Loop		mainLoop;
+extern volatile int		terminate;
+extern int				lfd;
+
+void	ClientInit(Client* c, struct Loop* l, int fd);
+void	Unblock(Client* c);
+int		InputReady();
+int		Serve(Client* c);
+
+int		RingLoop();
+
+#endif
+
@@ -0,0 +1,365 @@
+//
+// randload.c: load generator for randd
+//
+// Copyright (c) 2000, Sam Roberts
+//
+//  This program is free software; you can redistribute it and/or modify
+//  it under the terms of the GNU General Public License as published by
+//  the Free Software Foundation; either version 1, or (at your option)
+//  any later version.
+//
+//  This program is distributed in the hope that it will be useful,
+//  but WITHOUT ANY WARRANTY; without even the implied warranty of
+//  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+//  GNU General Public License for more details.
+//
+//  You should have received a copy of the GNU General Public License
+//  along with this program; if not, write to the Free Software
+//  Foundation, Inc., 675 Mass Ave, Cambridge, MA 02139, USA.
+//
+//  I can be contacted as sroberts@uniserve.com.
+//
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "randclient.h"
+#include "randd.h"
+
+char usage[] =
+	"Usage: %s [-h] [-u <socket>] [-o <op>] [-n <bytes>] [-c <count>]\n"
+	"          [-p <depth>]\n"
+	"\n"
+	"  -h   print this helpful message\n"
+	"  -u   randd's socket (default is " RANDD_SOCKET ")\n"
+	"  -o   request to make, one of:\n"
+	"         read      never blocking read (default)\n"
+	"         block     blocking read\n"
+	"         entcnt    get the entropy count\n"
+	"         add       add uncredited entropy\n"
+	"         lib       rand_bytes() from librandclient, seeded from\n"
+	"                   randd\n"
+	"  -n   bytes per read or add request (default 16)\n"
+	"  -c   requests to make (default 100000)\n"
+	"  -p   requests to keep in flight (default 1, no pipelining)\n"
+	;
+
+#define OP_LIB	0x100	// not a request, calls to librandclient
+
+struct
+{
+	const char*	name;
+	int			op;
+} ops[] = {
+	{ "read",	RANDD_READ },
+	{ "block",	RANDD_READ_BLOCK },
+	{ "entcnt",	RANDD_GETENTCNT },
+	{ "add",	RANDD_ADDENTROPY },
+	{ "lib",	OP_LIB },
+	{ 0 }
+};
+
+char*	arg0;
+
+void Error(const char* format, ...)
+{
+	va_list al;
+	va_start(al, format);
+	fprintf(stderr, "%s: ", arg0);
+	vfprintf(stderr, format, al);
+	fprintf(stderr, "\n");
+	va_end(al);
+	exit(1);
+}
+
+double Now()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int Compare(const void* a, const void* b)
+{
+	double x = *(const double*) a;
+	double y = *(const double*) b;
+
+	return x < y ? -1 : x > y;
+}
+
+/*
+* The latency that fraction p of the requests were faster than, from
+* sorted latencies.
+*/
+double Percentile(const double* lat, unsigned n, double p)
+{
+	unsigned i = (unsigned) (p * n);
+
+	return lat[i < n ? i : n - 1];
+}
+
+int Connect(const char* path)
+{
+	struct sockaddr_un	sun;
+	int					fd;
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	strncpy(sun.sun_path, path, sizeof(sun.sun_path) - 1);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if(fd == -1)
+		Error("socket failed: %s", strerror(errno));
+
+	if(connect(fd, (struct sockaddr*) &sun, sizeof(sun)) == -1)
+		Error("connect %s failed: %s", path, strerror(errno));
+
+	return fd;
+}
+
+void Write(int fd, const void* buf, size_t sz)
+{
+	const char* p = (const char*) buf;
+
+	while(sz > 0) {
+		ssize_t n = write(fd, p, sz);
+
+		if(n == -1) {
+			if(errno == EINTR)
+				continue;
+			Error("write failed: %s", strerror(errno));
+		}
+		p += n;
+		sz -= n;
+	}
+}
+void Read(int fd, void* buf, size_t sz)
+{
+	char* p = (char*) buf;
+
+	while(sz > 0) {
+		ssize_t n = read(fd, p, sz);
+
+		if(n == 0)
+			Error("randd closed the connection");
+		if(n == -1) {
+			if(errno == EINTR)
+				continue;
+			Error("read failed: %s", strerror(errno));
+		}
+		p += n;
+		sz -= n;
+	}
+}
+
+/*
+* Send request number tag.
+*/
+void Send(int fd, int op, unsigned len, unsigned tag)
+{
+	static char				data[RANDD_MAXDATA];
+	struct randd_request	req;
+
+	req.op = op;
+	req.len = len;
+	req.arg = 0;
+	req.tag = tag;
+
+	Write(fd, &req, sizeof(req));
+
+	if(op == RANDD_ADDENTROPY)
+		Write(fd, data, len);
+}
+
+// the data of the last reply received
+static char	replyData[RANDD_MAXDATA];
+static unsigned	replyArg;
+
+/*
+* Receive the reply to request number tag, returning the bytes of data
+* in it.
+*/
+unsigned Receive(int fd, unsigned tag)
+{
+	struct randd_reply	reply;
+
+	Read(fd, &reply, sizeof(reply));
+
+	if(reply.tag != tag)
+		Error("reply %u out of order, expected %u", reply.tag, tag);
+	if(reply.status)
+		Error("request %u failed: %s", tag, strerror(reply.status));
+	if(reply.len > RANDD_MAXDATA)
+		Error("reply %u has %u bytes of data", tag, reply.len);
+
+	Read(fd, replyData, reply.len);
+	replyArg = reply.arg;
+
+	return reply.len;
+}
+
+/*
+* Print the generator's reseeds, to show whether they kept up with the
+* load. There are none unless randd was started with -f.
+*/
+void Reseeds(int fd, unsigned tag)
+{
+	uint32_t us[3];
+
+	Send(fd, RANDD_RESEEDS, 0, tag);
+
+	if(Receive(fd, tag) != sizeof(us))
+		Error("reseeds reply has the wrong size");
+
+	memcpy(us, replyData, sizeof(us));
+
+	printf("reseeds %u, last %u us, max %u us, mean %u us\n", replyArg,
+		us[0], us[1], replyArg ? us[2] / replyArg : 0);
+}
+
+int main(int argc, char* argv[])
+{
+	const char*		path = RANDD_SOCKET;
+	int				op = RANDD_READ;
+	unsigned		len = 16;
+	unsigned		count = 100000;
+	unsigned		depth = 1;
+	unsigned		sent = 0;
+	unsigned		recvd = 0;
+	double			bytes = 0;
+	double			secs;
+	double			start;
+	double*			sendt;	// when each request in flight was sent
+	double*			lat;	// of each request, send to reply
+	int				fd;
+	int				opt;
+	int				i;
+
+	arg0 = strrchr(argv[0], '/');
+	arg0 = arg0 ? arg0 + 1 : argv[0];
+
+	while((opt = getopt(argc, argv, "hu:o:n:c:p:")) != -1) {
+		switch(opt) {
+		case 'h':
+			printf(usage, arg0);
+			exit(0);
+
+		case 'u':
+			path = optarg;
+			break;
+
+		case 'o':
+			for(i = 0; ops[i].name && strcmp(ops[i].name, optarg); i++)
+				;
+			if(!ops[i].name)
+				Error("unknown request %s", optarg);
+			op = ops[i].op;
+			break;
+
+		case 'n':
+			len = atoi(optarg);
+			break;
+
+		case 'c':
+			count = atoi(optarg);
+			break;
+
+		case 'p':
+			depth = atoi(optarg);
+			break;
+
+		default:
+			fprintf(stderr, usage, arg0);
+			exit(1);
+		}
+	}
+
+	if(len > RANDD_MAXDATA)
+		Error("-n %u is more than the maximum of %u", len, RANDD_MAXDATA);
+	if(depth < 1)
+		depth = 1;
+	if(op == RANDD_GETENTCNT)
+		len = 0;
+
+	if(count < 1)
+		count = 1;
+
+	sendt = (double*) malloc(depth * sizeof(double));
+	lat = (double*) malloc(count * sizeof(double));
+	if(!sendt || !lat)
+		Error("out of memory");
+
+	if(op == OP_LIB) {
+		static char buf[RANDD_MAXDATA];
+
+		if(rand_client_selftest() == -1)
+			Error("librandclient failed its ChaCha20 test vectors");
+		rand_client_source(path);
+
+		start = Now();
+
+		for(recvd = 0; recvd < count; recvd++) {
+			double t = Now();
+
+			if(rand_bytes(buf, len) == -1)
+				Error("rand_bytes failed: %s", strerror(errno));
+
+			lat[recvd] = Now() - t;
+			bytes += len;
+		}
+		secs = Now() - start;
+
+		qsort(lat, count, sizeof(double), Compare);
+
+		printf("%u calls of %u bytes, %lu seeds: %.3f s, %.0f calls/s,"
+			" %.2f MB/s\n", count, len, rand_client_seeds(), secs,
+			count / secs, bytes / secs / 1e6);
+		printf("latency us: p50 %.2f, p99 %.2f, max %.1f\n",
+			Percentile(lat, count, 0.50) * 1e6,
+			Percentile(lat, count, 0.99) * 1e6, lat[count - 1] * 1e6);
+		return 0;
+	}
+
+	fd = Connect(path);
+
+	start = Now();
+
+	while(recvd < count) {
+		// keep depth requests in flight
+		while(sent < count && sent - recvd < depth) {
+			sendt[sent % depth] = Now();
+			Send(fd, op, len, sent++);
+		}
+
+		bytes += Receive(fd, recvd);
+		lat[recvd] = Now() - sendt[recvd % depth];
+		recvd++;
+	}
+
+	secs = Now() - start;
+
+	qsort(lat, count, sizeof(double), Compare);
+
+	printf("%u requests of %u bytes, depth %u: %.3f s, %.0f req/s, %.2f MB/s\n",
+		count, len, depth, secs, count / secs, bytes / secs / 1e6);
+	printf("latency us: p50 %.1f, p99 %.1f, max %.1f\n",
+		Percentile(lat, count, 0.50) * 1e6, Percentile(lat, count, 0.99) * 1e6,
+		lat[count - 1] * 1e6);
+
+	Reseeds(fd, count);
+
+	close(fd);
+
+	return 0;
+}
+
@@ -237,7 +237,7 @@
  * the read(2) syscall to be interrupted. Copyright (C) 1998  Andrea Arcangeli
  */
 
-#ifdef __QNX__
+#if defined(__QNX__) || !defined(__KERNEL__)
 #define RANDOM
 #include "random.h"
 #else
@@ -414,6 +414,9 @@ static void begin_benchmark(struct random_benchmark *bench);
 static void end_benchmark(struct random_benchmark *bench);
 
 struct random_benchmark timer_benchmark;
+#ifdef RANDOM
+struct random_benchmark estimator_benchmark[RAND_EST_MAX];
+#endif
 #endif
 
 /* There is one of these per entropy source */
@@ -421,16 +424,41 @@ struct timer_rand_state {
 	__u32		last_time;
 	__s32		last_delta,last_delta2;
 	int		dont_count_entropy:1;
+#ifdef RANDOM
+	int		estimator;	/* RAND_EST_*, indexes estimators[] */
+	/* State for the health test estimator */
+	__u32		rct_sample, rct_count;
+	__u32		apt_sample, apt_count, apt_seen;
+	int		health_failed, window_failed;
+#endif
 };
 
 static struct random_bucket random_state;
-#ifndef __QNX__
+#ifndef RANDOM
 static struct timer_rand_state keyboard_timer_state;
 static struct timer_rand_state mouse_timer_state;
 #endif
 static struct timer_rand_state extract_timer_state;
+#ifdef RANDOM
+static int selftest_deterministic;	/* see rand_selftest() */
+
+/*
+ * The fast key erasure generator, see get_urandom_bytes().  Its seeded
+ * is when, by reseed_clock(), 0 to reseed.
+ */
+static struct rand_fke fke_state;
+static int output_mode = RAND_OUT_EXTRACT;
+
+/* Its reseed policy and metrics, see rand_reseed_due() */
+static int reseed_min_bits = RAND_RESEED_BITS;
+static int reseed_secs = RAND_RESEED_SECS;
+static int reseed_max_secs = RAND_RESEED_MAXSECS;
+static int reseed_scheduled;
+static struct rand_reseed_stats reseed_stats;
+static struct timespec reseed_start;
+#endif
 static struct timer_rand_state *irq_timer_state[NR_IRQS];
-#ifndef __QNX__
+#ifndef RANDOM
 static struct timer_rand_state *blkdev_timer_state[MAX_BLKDEV];
 static struct wait_queue *random_read_wait;
 static struct wait_queue *random_write_wait;
@@ -450,6 +478,11 @@ static inline void fast_add_entropy_words(struct random_bucket *r,
 					 __u32 x, __u32 y);
 
 static void add_entropy_words(struct random_bucket *r, __u32 x, __u32 y);
+#ifdef RANDOM
+static __u32 halfMD4Transform (__u32 const buf[4], __u32 const in[8]);
+static void halfMD4Transforms(__u32 const buf[4], __u32 const in[][8],
+			      __u32 *out, int n);
+#endif
 
 #ifndef MIN
 #define MIN(a,b) (((a) < (b)) ? (a) : (b))
@@ -515,13 +548,126 @@ static inline __u32 int_ln_12bits(__u32 word)
 }
 #endif
 
+#ifdef RANDOM
+/*
+ * Entropy estimators.
+ *
+ * An estimator is given the timestamp of each event from a source and
+ * returns the number of bits to credit for it.  Each source picks its
+ * estimator with rand_set_estimator(), the default is the original
+ * delta estimator.
+ */
+typedef __u32 (*entropy_estimator)(struct timer_rand_state *state,
+				   __u32 time);
+
+/*
+ * Take into account the first, second and third-order deltas, and
+ * credit the log of the smallest of them.
+ */
+static __u32 delta_estimate(struct timer_rand_state *state, __u32 time)
+{
+	__s32		delta, delta2, delta3;
+
+	delta = time - state->last_time;
+	state->last_time = time;
+
+	delta2 = delta - state->last_delta;
+	state->last_delta = delta;
+
+	delta3 = delta2 - state->last_delta2;
+	state->last_delta2 = delta2;
+
+	if (delta < 0)
+		delta = -delta;
+	if (delta2 < 0)
+		delta2 = -delta2;
+	if (delta3 < 0)
+		delta3 = -delta3;
+	if (delta > delta2)
+		delta = delta2;
+	if (delta > delta3)
+		delta = delta3;
+
+	/*
+	 * delta is now minimum absolute delta.
+	 * Round down by 1 bit on general principles,
+	 * and limit entropy entimate to 12 bits.
+	 */
+	delta >>= 1;
+	delta &= (1 << 12) - 1;
+
+	return int_ln_12bits(delta);
+}
+
+/*
+ * Health test estimator, after the continuous tests of NIST SP 800-90B,
+ * section 4.4.  The low byte of the inter-event time is the noise
+ * sample.  A fixed, assessed, min-entropy is credited per sample as
+ * long as both the repetition count test and the adaptive proportion
+ * test pass, nothing is credited from a trip until the end of the next
+ * clean window.  This is much more conservative than the delta
+ * estimator for sources with a periodic component, which the TSC
+ * resolves into large but predictable deltas.
+ */
+#define HEALTH_SAMPLE_BITS	2	/* assessed min-entropy per sample */
+#define HEALTH_RCT_CUTOFF	11	/* 1 + ceil(20 / HEALTH_SAMPLE_BITS) */
+#define HEALTH_APT_WINDOW	512
+#define HEALTH_APT_CUTOFF	311	/* H = 2, false positive rate 2^-20 */
+
+static __u32 health_estimate(struct timer_rand_state *state, __u32 time)
+{
+	__u32	sample = (time - state->last_time) & 0xff;
+
+	state->last_time = time;
+
+	/* Repetition count test */
+	if (sample == state->rct_sample) {
+		if (++state->rct_count >= HEALTH_RCT_CUTOFF)
+			state->window_failed = state->health_failed = 1;
+	} else {
+		state->rct_sample = sample;
+		state->rct_count = 1;
+	}
+
+	/* Adaptive proportion test */
+	if (state->apt_seen == 0) {
+		state->apt_sample = sample;
+		state->apt_count = 0;
+		state->health_failed = state->window_failed;
+		state->window_failed = 0;
+	}
+	if (sample == state->apt_sample &&
+	    ++state->apt_count >= HEALTH_APT_CUTOFF)
+		state->window_failed = state->health_failed = 1;
+	if (++state->apt_seen == HEALTH_APT_WINDOW)
+		state->apt_seen = 0;
+
+	return state->health_failed ? 0 : HEALTH_SAMPLE_BITS;
+}
+
+/*
+ * Mix, but never credit.
+ */
+static __u32 null_estimate(struct timer_rand_state *state, __u32 time)
+{
+	state->last_time = time;
+	return 0;
+}
+
+static entropy_estimator const estimators[RAND_EST_MAX] = {
+	delta_estimate,
+	health_estimate,
+	null_estimate
+};
+#endif
+
 
 /*
  * Initialize the random pool with standard stuff.
  *
  * NOTE: This is an OS-dependent function.
  */
-#ifdef __QNX__
+#ifdef RANDOM
 static char system_utsname[256];
 #endif
 static void init_std_data(struct random_bucket *r)
@@ -533,7 +679,7 @@ static void init_std_data(struct random_bucket *r)
 	do_gettimeofday(&tv);
 	add_entropy_words(r, tv.tv_sec, tv.tv_usec);
 
-#ifdef __QNX__
+#ifdef RANDOM
 	gethostname(system_utsname, sizeof(system_utsname));
 	system_utsname[sizeof(system_utsname) - 1] = '\0';
 #endif
@@ -555,16 +701,22 @@ static void rand_clear_pool(void)
 {
 	memset(&random_state, 0, sizeof(random_state));
 	init_std_data(&random_state);
+#ifdef RANDOM
+	memset(&fke_state, 0, sizeof(fke_state));
+#endif
 }
 
 __initfunc(void rand_initialize(void))
 {
 	int i;
 
+#ifdef RANDOM
+	cycles_init();
+#endif
 	rand_clear_pool();
 	for (i = 0; i < NR_IRQS; i++)
 		irq_timer_state[i] = NULL;
-#ifndef __QNX__
+#ifndef RANDOM
 	for (i = 0; i < MAX_BLKDEV; i++)
 		blkdev_timer_state[i] = NULL;
 	memset(&keyboard_timer_state, 0, sizeof(struct timer_rand_state));
@@ -573,15 +725,20 @@ __initfunc(void rand_initialize(void))
 	memset(&extract_timer_state, 0, sizeof(struct timer_rand_state));
 #ifdef RANDOM_BENCHMARK
 	initialize_benchmark(&timer_benchmark, "timer", 0);
+#ifdef RANDOM
+	initialize_benchmark(&estimator_benchmark[RAND_EST_DELTA], "delta", 0);
+	initialize_benchmark(&estimator_benchmark[RAND_EST_HEALTH], "health", 0);
+	initialize_benchmark(&estimator_benchmark[RAND_EST_NONE], "none", 0);
+#endif
 #endif
 	extract_timer_state.dont_count_entropy = 1;
-#ifndef __QNX__
+#ifndef RANDOM
 	random_read_wait = NULL;
 	random_write_wait = NULL;
 #endif
 }
 
-#ifdef __QNX__
+#ifdef RANDOM
 int rand_initialize_irq(int irq)
 #else
 void rand_initialize_irq(int irq)
@@ -590,7 +747,7 @@ void rand_initialize_irq(int irq)
 	struct timer_rand_state *state;
 	
 	if (irq >= NR_IRQS || irq_timer_state[irq])
-#ifdef __QNX__
+#ifdef RANDOM
 		return 0;
 #else
 		return;
@@ -605,7 +762,7 @@ void rand_initialize_irq(int irq)
 		irq_timer_state[irq] = state;
 		memset(state, 0, sizeof(struct timer_rand_state));
 	}
-#ifdef __QNX__
+#ifdef RANDOM
 	if(state)
 		return 1;
 	else
@@ -613,7 +770,20 @@ void rand_initialize_irq(int irq)
 #endif
 }
 
-#ifndef __QNX__
+#ifdef RANDOM
+int rand_set_estimator(int irq, int estimator)
+{
+	if (irq >= NR_IRQS || irq_timer_state[irq] == 0)
+		return 0;
+	if (estimator < 0 || estimator >= RAND_EST_MAX)
+		return 0;
+
+	irq_timer_state[irq]->estimator = estimator;
+	return 1;
+}
+#endif
+
+#ifndef RANDOM
 void rand_initialize_blkdev(int major, int mode)
 {
 	struct timer_rand_state *state;
@@ -723,6 +893,18 @@ static void add_entropy_words(struct random_bucket *r, __u32 x, __u32 y)
 	fast_add_entropy_words(r, x, y);
 }
 
+/*
+ * Credit the pool with bits of entropy, up to its size.
+ */
+static void credit_timer_entropy(struct random_bucket *r, int bits)
+{
+	r->entropy_count += bits;
+
+	/* Prevent overflow */
+	if (r->entropy_count > POOLBITS)
+		r->entropy_count = POOLBITS;
+}
+
 /*
  * This function adds entropy to the entropy "pool" by using timing
  * delays.  It uses the timer_rand_state structure to make an estimate
@@ -735,6 +917,50 @@ static void add_entropy_words(struct random_bucket *r, __u32 x, __u32 y)
  * are used for a high-resolution timer.
  *
  */
+#ifdef RANDOM
+/*
+ * The mixing and crediting half of add_timer_randomness(), for a
+ * sample that may have been timestamped some time ago.
+ */
+static void add_timer_sample(struct random_bucket *r,
+			     struct timer_rand_state *state, unsigned num,
+			     __u32 time)
+{
+#ifdef RANDOM_BENCHMARK
+	begin_benchmark(&timer_benchmark);
+#endif
+	fast_add_entropy_words(r, (__u32)num, time);
+
+	/*
+	 * Ask the source's estimator how many bits of randomness we
+	 * probably added.  It sees every sample, even with a full pool,
+	 * so that stateful estimators track the source continuously.
+	 */
+	if (!state->dont_count_entropy) {
+#ifdef RANDOM_BENCHMARK
+		begin_benchmark(&estimator_benchmark[state->estimator]);
+#endif
+		credit_timer_entropy(r,
+			estimators[state->estimator](state, time));
+#ifdef RANDOM_BENCHMARK
+		end_benchmark(&estimator_benchmark[state->estimator]);
+#endif
+	}
+#ifdef RANDOM_BENCHMARK
+	end_benchmark(&timer_benchmark);
+#endif
+}
+
+static void add_timer_randomness(struct random_bucket *r,
+				 struct timer_rand_state *state, unsigned num)
+{
+	/* The best counter available was picked by cycles_init() */
+	unsigned high;
+	__u32 time = cycles_read(&high);
+
+	add_timer_sample(r, state, num ^ high, time);
+}
+#else
 static void add_timer_randomness(struct random_bucket *r,
 				 struct timer_rand_state *state, unsigned num)
 {
@@ -745,22 +971,7 @@ static void add_timer_randomness(struct random_bucket *r,
 	begin_benchmark(&timer_benchmark);
 #endif
 #if defined (__i386__)
-#ifdef __QNX4__
-	// See the CPUID Instruction, from 3-71, it has a flag that
-	// says whether the TSC is available, but you have to check
-	// the EFLAGS register to see if CPUID is supported (3-75).
-	{
-		long64 l64;
-		rdtsc64(&l64);
-		time = l64.lo;
-		num ^= l64.hi;
-	}
-#else
-#ifndef __QNXNTO__
 	if (boot_cpu_data.x86_capability & X86_FEATURE_TSC) {
-#else
-	if (1) {
-#endif
 		__u32 high;
 		__asm__(".byte 0x0f,0x31"
 			:"=a" (time), "=d" (high));
@@ -768,7 +979,6 @@ static void add_timer_randomness(struct random_bucket *r,
 	} else {
 		time = jiffies;
 	}
-#endif
 #else
 	time = jiffies;
 #endif
@@ -809,11 +1019,7 @@ static void add_timer_randomness(struct random_bucket *r,
 		delta >>= 1;
 		delta &= (1 << 12) - 1;
 
-		r->entropy_count += int_ln_12bits(delta);
-
-		/* Prevent overflow */
-		if (r->entropy_count > POOLBITS)
-			r->entropy_count = POOLBITS;
+		credit_timer_entropy(r, int_ln_12bits(delta));
 
 		/* Wake up waiting processes, if we have enough entropy. */
 //		if (r->entropy_count >= WAIT_INPUT_BITS)
@@ -824,8 +1030,9 @@ static void add_timer_randomness(struct random_bucket *r,
 	end_benchmark(&timer_benchmark);
 #endif
 }
+#endif
 
-#ifndef __QNX__
+#ifndef RANDOM
 void add_keyboard_randomness(unsigned char scancode)
 {
 	add_timer_randomness(&random_state, &keyboard_timer_state, scancode);
@@ -845,7 +1052,18 @@ void add_interrupt_randomness(int irq)
 	add_timer_randomness(&random_state, irq_timer_state[irq], 0x100+irq);
 }
 
-#ifndef __QNX__
+#ifdef RANDOM
+void add_interrupt_sample(int irq, unsigned time, unsigned high)
+{
+	if (irq >= NR_IRQS || irq_timer_state[irq] == 0)
+		return;
+
+	add_timer_sample(&random_state, irq_timer_state[irq],
+			 (0x100+irq) ^ high, time);
+}
+#endif
+
+#ifndef RANDOM
 void add_blkdev_randomness(int major)
 {
 	if (major >= MAX_BLKDEV)
@@ -1276,7 +1494,7 @@ static ssize_t extract_entropy(struct random_bucket *r, char * buf,
 	else
 		r->entropy_count = 0;
 
-#ifndef __QNX__
+#ifndef RANDOM
 	if (r->entropy_count < WAIT_OUTPUT_BITS)
 		wake_up_interruptible(&random_write_wait);
 #endif
@@ -1315,14 +1533,19 @@ static ssize_t extract_entropy(struct random_bucket *r, char * buf,
 		}
 #if HASH_BUFFER_SIZE & 1	/* There's a middle word to deal with */
 		x = tmp[HASH_BUFFER_SIZE/2];
+#ifdef RANDOM
+		add_entropy_words(r, x, selftest_deterministic ? 0 :
+				  (__u32)((unsigned long)buf));
+#else
 		add_entropy_words(r, x, (__u32)((unsigned long)buf));
+#endif
 		x ^= (x >> 16);		/* Fold it in half */
 		((__u16 *)tmp)[HASH_BUFFER_SIZE-1] = (__u16)x;
 #endif
 		
 		/* Copy data to destination buffer */
 		i = MIN(nbytes, HASH_BUFFER_SIZE*sizeof(__u32)/2);
-#ifndef __QNX__
+#ifndef RANDOM
 		if (to_user) {
 			i -= copy_to_user(buf, (__u8 const *)tmp, i);
 			if (!i) {
@@ -1335,7 +1558,7 @@ static ssize_t extract_entropy(struct random_bucket *r, char * buf,
 		nbytes -= i;
 		buf += i;
 		add_timer_randomness(r, &extract_timer_state, nbytes);
-#ifndef __QNX__
+#ifndef RANDOM
 		if (to_user && current->need_resched)
 		{
 			if (signal_pending(current))
@@ -1363,14 +1586,599 @@ void get_random_bytes(void *buf, int nbytes)
 {
 	extract_entropy(&random_state, (char *) buf, nbytes, 0);
 }
-#ifdef __QNX__
+#ifdef RANDOM
+/*
+ * Like get_random_bytes(), but leaving the entropy count alone, for
+ * the seed file.  The seed carries the pool's entropy across a restart
+ * rather than consuming it, so saving one mustn't take the credit away
+ * from blocked readers.
+ */
+void get_seed_bytes(void *buf, int nbytes)
+{
+	int count = random_state.entropy_count;
+
+	extract_entropy(&random_state, (char *) buf, nbytes, 0);
+
+	random_state.entropy_count = count;
+}
+
 int get_random_size(void)
 {
 	return random_state.entropy_count / 8;
 }
+
+/*
+ * True when a reader blocked on the pool could make progress, the
+ * condition random_read_wait is woken for under Linux.
+ */
+int rand_input_ready(void)
+{
+	return random_state.entropy_count >= WAIT_INPUT_BITS;
+}
+
+/*
+ * True when the pool is low enough that a writer should feed it, the
+ * condition random_write_wait is woken for under Linux.
+ */
+int rand_output_ready(void)
+{
+	return random_state.entropy_count < WAIT_OUTPUT_BITS;
+}
+
+/*
+ * Mix a buffer into the pool, as random_write() does, and credit it
+ * with entropy_bits, limited to 8 bits a byte.
+ */
+void add_random_bytes(const void *buf, int nbytes, int entropy_bits)
+{
+	__u32		words[2];
+	const char	*p = (const char *) buf;
+	int		n = nbytes;
+
+	while (n > 0) {
+		words[0] = words[1] = 0;
+		memcpy(words, p, MIN(n, sizeof(words)));
+		add_entropy_words(&random_state, words[0], words[1]);
+		p += sizeof(words);
+		n -= sizeof(words);
+	}
+	memset(words, 0, sizeof(words));
+
+	if (entropy_bits > nbytes * 8)
+		entropy_bits = nbytes * 8;
+	if (entropy_bits > 0) {
+		random_state.entropy_count += entropy_bits;
+		if (random_state.entropy_count > POOLBITS)
+			random_state.entropy_count = POOLBITS;
+	}
+}
+
+/*
+ * The entropy count commands of random_ioctl(), for the drivers'
+ * devctl()s.  Checking the client's privileges is up to the caller.
+ */
+int rand_get_entcnt(void)
+{
+	return random_state.entropy_count;
+}
+
+void rand_add_entcnt(int ent_count)
+{
+	/*
+	 * Add ent_count to entropy_count, limiting the result to be
+	 * between 0 and POOLBITS.
+	 */
+	if (ent_count < -(int) random_state.entropy_count)
+		random_state.entropy_count = 0;
+	else if (ent_count > POOLBITS)
+		random_state.entropy_count = POOLBITS;
+	else {
+		random_state.entropy_count += ent_count;
+		if (random_state.entropy_count > POOLBITS)
+			random_state.entropy_count = POOLBITS;
+	}
+}
+
+void rand_zap_entcnt(void)
+{
+	random_state.entropy_count = 0;
+}
+
+/*
+ * Fast key erasure output, for unlimited readers.
+ *
+ * extract_entropy() hashes the whole pool, 128 transforms, for every
+ * 10 bytes it returns, and feeds the hash back into the pool so the
+ * output can't be recomputed from the pool afterwards.  With
+ * RAND_OUT_FKE, get_urandom_bytes() runs a generator keyed from the
+ * pool instead.  A block of output is HASH_TRANSFORM of a message
+ * block holding a 256 bit key and a counter.  Each request first runs
+ * the generator for a new key, and overwrites the old key with it
+ * before producing any output under the old one.  A request costs two
+ * transforms, plus one per 20 bytes of output, whatever the pool's
+ * size.
+ *
+ * The security model:
+ *
+ * - Output is as unpredictable as the key, if the hash's compression
+ *   function is a PRF when keyed through its message block, the same
+ *   assumption that makes extract_entropy()'s output unpredictable.
+ *
+ * - Backtracking: when a request returns, its key has been erased, and
+ *   the key left is generator output that reveals nothing of it.  So
+ *   a compromise of the state doesn't reveal output already returned,
+ *   which is what extract_entropy()'s feedback provides.  Erasure does
+ *   nothing for output still to come.
+ *
+ * - Prediction: after a compromise, output is predictable until the
+ *   next reseed, and only reseeds recover from it.  A reseed takes
+ *   FKE_SEED_BYTES from the pool, with extract_entropy() and its
+ *   accounting, and xors them into the key.  Reseeds happen before the
+ *   first output, and then as rand_reseed_due() decides, which is at
+ *   least every reseed_max_secs.
+ *
+ * - Blocking reads and get_random_bytes() still extract from the pool
+ *   directly.  Only reseeds debit the pool's entropy count, so
+ *   urandom readers no longer drain it.
+ */
+#define FKE_SEED_BYTES		(RAND_SEED_WORDS * sizeof(__u32))
+#define FKE_CHUNK		4096	/* most output under one key */
+#define FKE_DOMAIN		0x666b6531	/* "fke1", unlike any pool data */
+
+static void fke_block(const __u32 key[8], __u32 counter,
+		      __u32 out[HASH_BUFFER_SIZE + HASH_EXTRA_SIZE])
+{
+	__u32 data[16];
+
+	memcpy(data, key, 8 * sizeof(__u32));
+	data[8] = counter;
+	data[9] = FKE_DOMAIN;
+	memset(data + 10, 0, 6 * sizeof(__u32));
+
+	out[0] = 0x67452301;
+	out[1] = 0xefcdab89;
+	out[2] = 0x98badcfe;
+	out[3] = 0x10325476;
+#ifdef USE_SHA
+	out[4] = 0xc3d2e1f0;
+#endif
+	HASH_TRANSFORM(out, data);
+
+	memset(data, 0, sizeof(data));
+}
+
+/*
+ * Replace s's key with the generator's first output, then fill buf
+ * with the following output under the old key, at most FKE_CHUNK bytes.
+ */
+static void fke_generate(struct rand_fke *s, char *buf, int nbytes)
+{
+	__u32 key[8];
+	__u32 tmp[HASH_BUFFER_SIZE + HASH_EXTRA_SIZE];
+	__u32 counter = 0;
+	int i;
+
+	memcpy(key, s->key, sizeof(key));
+
+	for (i = 0; i < 8; i += HASH_BUFFER_SIZE) {
+		fke_block(key, counter++, tmp);
+		memcpy(s->key + i, tmp,
+		       MIN(HASH_BUFFER_SIZE, 8 - i) * sizeof(__u32));
+	}
+
+	while (nbytes > 0) {
+		fke_block(key, counter++, tmp);
+		i = MIN(nbytes, HASH_BUFFER_SIZE * sizeof(__u32));
+		memcpy(buf, tmp, i);
+		buf += i;
+		nbytes -= i;
+	}
+
+	memset(key, 0, sizeof(key));
+	memset(tmp, 0, sizeof(tmp));
+}
+
+/*
+ * Reseeding.
+ *
+ * A reseed is due before the first output, and after that once
+ * reseed_secs have passed, if the pool has reseed_min_bits of entropy
+ * to give.  Waiting for the entropy means an attacker who knows the key
+ * can't follow a reseed by guessing the little that went into it.  But
+ * a pool that's never credited, like randd's by default, would never
+ * reseed, so once reseed_max_secs have passed one is due whatever the
+ * count: the pool still has whatever went into it uncredited.  Until
+ * then, rand_reseed_starved() says the count is holding reseeds back.
+ *
+ * Without a scheduler, get_urandom_bytes() reseeds when due, and the
+ * reader that finds it due pays for hashing the pool.  A driver with a
+ * thread to spare calls rand_reseed_schedule(1), seeds once with
+ * rand_reseed(), and then reseeds from the thread whenever
+ * rand_reseed_due().  get_urandom_bytes() then only touches the key,
+ * never the pool, so the driver can give readers a lock of their own:
+ * rand_reseed_extract() needs the pool locked, and
+ * rand_reseed_install() the key.
+ */
+/*
+ * Reseeds are timed on a clock that isn't stepped, so setting the time
+ * of day neither holds them back nor brings them early.
+ */
+static void reseed_time(struct timespec *ts)
+{
+#ifdef CLOCK_MONOTONIC
+	clock_gettime(CLOCK_MONOTONIC, ts);
+#else
+	clock_gettime(CLOCK_REALTIME, ts);
 #endif
+}
+
+static time_t reseed_clock(void)
+{
+	struct timespec ts;
+
+	reseed_time(&ts);
+	return ts.tv_sec;
+}
+
+int rand_reseed_due(void)
+{
+	time_t age;
+
+	if (!fke_state.seeded)
+		return 1;
+	age = reseed_clock() - fke_state.seeded;
+	if (age < reseed_secs)
+		return 0;
+	if (random_state.entropy_count >= reseed_min_bits)
+		return 1;
+	return age >= reseed_max_secs;
+}
+
+int rand_reseed_starved(void)
+{
+	if (!fke_state.seeded)
+		return 0;
+	if (reseed_clock() - fke_state.seeded < reseed_secs)
+		return 0;
+	return random_state.entropy_count < reseed_min_bits;
+}
+
+void rand_set_reseed_policy(int min_bits, int secs)
+{
+	if (min_bits < 0)
+		min_bits = 0;
+	if (secs < 0)
+		secs = 0;
+	reseed_min_bits = MIN(min_bits, POOLBITS);
+	reseed_secs = secs;
+	reseed_max_secs = secs > RAND_RESEED_MAXSECS ? secs : RAND_RESEED_MAXSECS;
+}
+
+void rand_reseed_schedule(int on)
+{
+	reseed_scheduled = on;
+}
+
+void rand_reseed_extract(unsigned seed[RAND_SEED_WORDS])
+{
+	reseed_time(&reseed_start);
+	extract_entropy(&random_state, (char *) seed, FKE_SEED_BYTES, 0);
+}
+
+void rand_fke_install(struct rand_fke *g, const unsigned seed[RAND_SEED_WORDS])
+{
+	int i;
+
+	for (i = 0; i < RAND_SEED_WORDS; i++)
+		g->key[i] ^= seed[i];
+
+	g->seeded = reseed_clock();
+	if (!g->seeded)
+		g->seeded = 1;
+}
 
-#ifndef __QNX__
+void rand_reseed_install(const unsigned seed[RAND_SEED_WORDS])
+{
+	struct timespec now;
+	unsigned long us;
+
+	rand_fke_install(&fke_state, seed);
+
+	/* from the pool being hashed to the key being installed */
+	reseed_time(&now);
+	us = (now.tv_sec - reseed_start.tv_sec) * 1000000L +
+		(now.tv_nsec - reseed_start.tv_nsec) / 1000;
+
+	reseed_stats.count++;
+	reseed_stats.last_us = us;
+	reseed_stats.total_us += us;
+	if (us > reseed_stats.max_us)
+		reseed_stats.max_us = us;
+}
+
+void rand_reseed(void)
+{
+	unsigned seed[RAND_SEED_WORDS];
+
+	rand_reseed_extract(seed);
+	rand_reseed_install(seed);
+	memset(seed, 0, sizeof(seed));
+}
+
+void rand_get_reseed_stats(struct rand_reseed_stats *st)
+{
+	*st = reseed_stats;
+}
+
+int rand_set_output(int mode)
+{
+	if (mode < 0 || mode >= RAND_OUT_MAX)
+		return 0;
+
+	output_mode = mode;
+	return 1;
+}
+
+/*
+ * Output for unlimited readers, /dev/urandom, as selected by
+ * rand_set_output().
+ */
+void get_urandom_bytes(void *buf, int nbytes)
+{
+	char *p = (char *) buf;
+	int n;
+
+	if (output_mode != RAND_OUT_FKE) {
+		extract_entropy(&random_state, p, nbytes, 0);
+		return;
+	}
+
+	/*
+	 * The request's timing is mixed in, as extract_entropy() does,
+	 * unless a scheduler has the pool.  With one, an unseeded key is
+	 * the driver's bug, but it's seeded here rather than used.
+	 */
+	if (!reseed_scheduled)
+		add_timer_randomness(&random_state, &extract_timer_state, nbytes);
+
+	while (nbytes > 0) {
+		n = MIN(nbytes, FKE_CHUNK);
+		if (reseed_scheduled ? !fke_state.seeded : rand_reseed_due())
+			rand_reseed();
+		fke_generate(&fke_state, p, n);
+		p += n;
+		nbytes -= n;
+	}
+}
+
+/*
+ * Output from one of the driver's generators, see random.h.
+ */
+void get_urandom_bytes_fke(struct rand_fke *g, void *buf, int nbytes)
+{
+	char *p = (char *) buf;
+	int n;
+
+	while (nbytes > 0) {
+		n = MIN(nbytes, FKE_CHUNK);
+		fke_generate(g, p, n);
+		p += n;
+		nbytes -= n;
+	}
+}
+#endif
+
+#ifdef RANDOM
+/*
+ * Self tests: known answers for the pool's mixing, hashing and output,
+ * and the FIPS 140-2 statistical tests over its output.
+ *
+ * While they run, the pool is driven by a counting clock in place of
+ * the cycle counter, and extract_entropy() doesn't mix in the
+ * address of its buffer, so the pool's contents and output are
+ * reproducible.  The pool is restored when they're done.
+ */
+static __u32 selftest_time;
+
+static unsigned selftest_read(unsigned *high)
+{
+	*high = 0;
+	return selftest_time += 1000;
+}
+
+static struct cycle_source selftest_clock = {
+	"selftest", 1, 1, 0, selftest_read
+};
+
+static int selftest_result(const char *name, int ok)
+{
+	printk("selftest %-14s %s\n", name, ok ? "ok" : "FAILED");
+	return !ok;
+}
+
+/* Fold the pool into a single word, to compare to a known answer. */
+static __u32 selftest_pool_sum(struct random_bucket *r)
+{
+	__u32 sum = 0;
+	int i;
+
+	for (i = 0; i < POOLWORDS; i++)
+		sum = ((sum << 5) | (sum >> 27)) ^ r->pool[i];
+	return sum;
+}
+
+/* FIPS 140-2 monobit, poker, runs and long run tests, over 20000 bits */
+#define FIPS_BYTES 2500
+
+static int selftest_fips(const unsigned char *buf)
+{
+	static const int runs_min[6] = { 2315, 1114, 527, 240, 103, 103 };
+	static const int runs_max[6] = { 2685, 1386, 723, 384, 209, 209 };
+	int ones = 0, poker[16], runs[2][6];
+	int run = 0, longest = 0, last = -1;
+	long x;
+	int i, b, failed = 0;
+
+	memset(poker, 0, sizeof(poker));
+	memset(runs, 0, sizeof(runs));
+
+	for (i = 0; i < FIPS_BYTES; i++) {
+		poker[buf[i] >> 4]++;
+		poker[buf[i] & 15]++;
+		for (b = 7; b >= 0; b--) {
+			int bit = (buf[i] >> b) & 1;
+
+			ones += bit;
+			if (bit == last) {
+				run++;
+				continue;
+			}
+			if (last >= 0)
+				runs[last][MIN(run, 6) - 1]++;
+			if (run > longest)
+				longest = run;
+			last = bit;
+			run = 1;
+		}
+	}
+	runs[last][MIN(run, 6) - 1]++;
+	if (run > longest)
+		longest = run;
+
+	failed += selftest_result("fips monobit",
+				  ones > 9725 && ones < 10275);
+
+	/* X = 16/5000 * sum(f^2) - 5000, so 5000 X is an integer */
+	for (x = 0, i = 0; i < 16; i++)
+		x += (long) poker[i] * poker[i];
+	x = 16 * x - 5000L * 5000L;
+	failed += selftest_result("fips poker", x > 10800 && x < 230850);
+
+	for (b = 0, i = 0; i < 6; i++) {
+		if (runs[0][i] < runs_min[i] || runs[0][i] > runs_max[i] ||
+		    runs[1][i] < runs_min[i] || runs[1][i] > runs_max[i])
+			b++;
+	}
+	failed += selftest_result("fips runs", b == 0);
+	failed += selftest_result("fips long run", longest < 26);
+
+	return failed;
+}
+
+#define SELFTEST_HASHES	63	/* not a multiple of 4, to test the tail */
+#define SELFTEST_COOKIES	16
+
+static int selftest_syncookies(void);
+
+/*
+ * Run the self tests, printing a line for each, and return the
+ * number that failed.
+ */
+int rand_selftest(void)
+{
+	/* SHA-1 of "abc", FIPS 180-1 appendix A */
+	static __u32 const sha_abc[16] = {
+		0x61626380, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x18 };
+	static __u32 const sha_abc_digest[5] = {
+		0xa9993e36, 0x4706816a, 0xba3e2571, 0x7850c26c, 0x9cd0d89d };
+	/* from this implementation, for the inputs below */
+	static __u32 const mix_sum = 0x45d74f8f;
+	static __u32 const extract_words[4] = {
+		0x3d1e3825, 0x91678537, 0x3fb5b283, 0x09024548 };
+	/* from this implementation, checked against a separate SHA-1 */
+	static __u32 const fke_words[4] = {
+		0x71209d51, 0xc7140b06, 0xaa34baeb, 0xafa780f5 };
+	static __u32 const fke_key[8] = {
+		0x5e281665, 0x0da14014, 0x4e24d529, 0x042dee5f,
+		0x086ca160, 0x4ef3778f, 0x42f3f9bd, 0x019a8de5 };
+
+	static struct random_bucket saved;
+	static unsigned char fips[FIPS_BYTES];
+	static __u32 hash_in[SELFTEST_HASHES][8];
+	static __u32 hash_out[SELFTEST_HASHES];
+	static struct rand_fke fke;
+	struct cycle_source *clock = cycle_source;
+	__u32 tmp[HASH_BUFFER_SIZE + HASH_EXTRA_SIZE];
+	__u32 out[4];
+	int i, failed = 0;
+
+	saved = random_state;
+	cycle_source = &selftest_clock;
+	selftest_time = 0;
+	selftest_deterministic = 1;
+
+#ifdef USE_SHA
+	tmp[0] = 0x67452301;
+	tmp[1] = 0xefcdab89;
+	tmp[2] = 0x98badcfe;
+	tmp[3] = 0x10325476;
+	tmp[4] = 0xc3d2e1f0;
+	SHATransform(tmp, sha_abc);
+	failed += selftest_result("sha1 abc",
+				  memcmp(tmp, sha_abc_digest, sizeof(sha_abc_digest)) == 0);
+#endif
+
+	/* any key will do, so use the digest */
+	for (i = 0; i < 8; i++)
+		tmp[i] = i * 0x01010101;
+	failed += selftest_result("halfmd4",
+				  halfMD4Transform(sha_abc_digest, tmp) == 0xe040f273);
+
+	/* the batch transform, SIMD if available, against the scalar one */
+	for (i = 0; i < 8 * SELFTEST_HASHES; i++)
+		hash_in[i / 8][i % 8] = i * 0x9e3779b9;
+	halfMD4Transforms(sha_abc_digest, hash_in, hash_out, SELFTEST_HASHES);
+	for (i = 0; i < SELFTEST_HASHES; i++) {
+		if (hash_out[i] != halfMD4Transform(sha_abc_digest, hash_in[i]))
+			break;
+	}
+	failed += selftest_result(cpu_has_sse2 ? "halfmd4 sse2" : "halfmd4 batch",
+				  i == SELFTEST_HASHES);
+
+	/* mix a known sequence into an empty pool */
+	memset(&random_state, 0, sizeof(random_state));
+	for (i = 0; i < 4 * POOLWORDS; i++)
+		fast_add_entropy_words(&random_state, i, ~i * 0x9e3779b9);
+	failed += selftest_result("pool mixing",
+				  selftest_pool_sum(&random_state) == mix_sum);
+
+	extract_entropy(&random_state, (char *) out, sizeof(out), 0);
+	failed += selftest_result("extract",
+				  memcmp(out, extract_words, sizeof(out)) == 0);
+
+	extract_entropy(&random_state, (char *) fips, sizeof(fips), 0);
+	failed += selftest_fips(fips);
+
+	/*
+	 * The fast key erasure generator: a known answer, a new key that
+	 * isn't the old one, and FIPS over its output.
+	 */
+	memset(&fke, 0, sizeof(fke));
+	for (i = 0; i < 8; i++)
+		fke.key[i] = i * 0x01010101;
+	fke_generate(&fke, (char *) out, sizeof(out));
+	failed += selftest_result("fke",
+				  memcmp(out, fke_words, sizeof(out)) == 0 &&
+				  memcmp(fke.key, fke_key, sizeof(fke_key)) == 0);
+	for (i = 0; i < FIPS_BYTES; i += 16)
+		fke_generate(&fke, (char *) fips + i, MIN(16, FIPS_BYTES - i));
+	failed += selftest_fips(fips);
+	memset(&fke, 0, sizeof(fke));
+
+	memset(tmp, 0, sizeof(tmp));
+	memset(fips, 0, sizeof(fips));
+	random_state = saved;
+	memset(&saved, 0, sizeof(saved));
+	selftest_deterministic = 0;
+	cycle_source = clock;
+
+	failed += selftest_syncookies();
+
+	return failed;
+}
+#endif
+
+#ifndef RANDOM
 static ssize_t
 random_read(struct file * file, char * buf, size_t nbytes, loff_t *ppos)
 {
@@ -1424,7 +2232,7 @@ random_read(struct file * file, char * buf, size_t nbytes, loff_t *ppos)
 }
 #endif
 
-#ifndef __QNX__
+#ifndef RANDOM
 static ssize_t
 random_read_unlimited(struct file * file, char * buf,
 		      size_t nbytes, loff_t *ppos)
@@ -1433,7 +2241,7 @@ random_read_unlimited(struct file * file, char * buf,
 }
 #endif
 
-#ifndef __QNX__
+#ifndef RANDOM
 static unsigned int
 random_poll(struct file *file, poll_table * wait)
 {
@@ -1450,7 +2258,7 @@ random_poll(struct file *file, poll_table * wait)
 }
 #endif
 
-#ifndef __QNX__
+#ifndef RANDOM
 static ssize_t
 random_write(struct file * file, const char * buffer,
 	     size_t count, loff_t *ppos)
@@ -1488,7 +2296,7 @@ random_write(struct file * file, const char * buffer,
 }
 #endif
 
-#ifndef __QNX__
+#ifndef RANDOM
 static int
 random_ioctl(struct inode * inode, struct file * file,
 	     unsigned int cmd, unsigned long arg)
@@ -1599,7 +2407,7 @@ random_ioctl(struct inode * inode, struct file * file,
 }
 #endif
 
-#ifndef __QNX__
+#ifndef RANDOM
 struct file_operations random_fops = {
 	NULL,		/* random_lseek */
 	random_read,
@@ -1627,7 +2435,6 @@ struct file_operations urandom_fops = {
 };
 #endif
 
-#ifndef __QNX__
 /*
  * TCP initial sequence number picking.  This uses the random number
  * generator to pick an initial secret value.  This value is hashed
@@ -1699,6 +2506,116 @@ static __u32 halfMD4Transform (__u32 const buf[4], __u32 const in[8])
 	/* Alternative: return sum of all words? */
 }
 
+#ifdef RANDOM
+/*
+ * The same transform, four inputs at a time, one in each 32-bit lane
+ * of the SSE2 registers.  It's compiled for SSE2 whatever the target,
+ * and only called if cycles_init() found SSE2, see halfMD4Transforms().
+ */
+#if defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__)) && \
+    (__GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9))
+#define HALFMD4_SSE2
+#include <emmintrin.h>
+
+#define F4(x, y, z) _mm_xor_si128(z, _mm_and_si128(x, _mm_xor_si128(y, z)))
+#define G4(x, y, z) _mm_add_epi32(_mm_and_si128(x, y), \
+				  _mm_and_si128(_mm_xor_si128(x, y), z))
+#define H4(x, y, z) _mm_xor_si128(_mm_xor_si128(x, y), z)
+
+#define ROUND4(f, a, b, c, d, x, k, s)					\
+	(a = _mm_add_epi32(a, _mm_add_epi32(f(b, c, d),			\
+		_mm_add_epi32(w[x], _mm_set1_epi32(k)))),		\
+	 a = _mm_or_si128(_mm_slli_epi32(a, s), _mm_srli_epi32(a, 32-s)))
+
+__attribute__((target("sse2")))
+static void halfMD4Transform4(__u32 const buf[4], __u32 const in[][8],
+			      __u32 out[4])
+{
+	__m128i	a = _mm_set1_epi32(buf[0]), b = _mm_set1_epi32(buf[1]);
+	__m128i	c = _mm_set1_epi32(buf[2]), d = _mm_set1_epi32(buf[3]);
+	__m128i	w[8], t0, t1, t2, t3;
+	int	i;
+
+	/* transpose the inputs, so w[i] holds word i of each */
+	for (i = 0; i < 8; i += 4) {
+		t0 = _mm_loadu_si128((const __m128i *) &in[0][i]);
+		t1 = _mm_loadu_si128((const __m128i *) &in[1][i]);
+		t2 = _mm_loadu_si128((const __m128i *) &in[2][i]);
+		t3 = _mm_loadu_si128((const __m128i *) &in[3][i]);
+		w[i+0] = _mm_unpacklo_epi32(t0, t1);	/* 00 10 01 11 */
+		w[i+1] = _mm_unpacklo_epi32(t2, t3);	/* 20 30 21 31 */
+		w[i+2] = _mm_unpackhi_epi32(t0, t1);	/* 02 12 03 13 */
+		w[i+3] = _mm_unpackhi_epi32(t2, t3);	/* 22 32 23 33 */
+		t0 = _mm_unpacklo_epi64(w[i+0], w[i+1]);
+		t1 = _mm_unpackhi_epi64(w[i+0], w[i+1]);
+		t2 = _mm_unpacklo_epi64(w[i+2], w[i+3]);
+		t3 = _mm_unpackhi_epi64(w[i+2], w[i+3]);
+		w[i+0] = t0;
+		w[i+1] = t1;
+		w[i+2] = t2;
+		w[i+3] = t3;
+	}
+
+	/* Round 1 */
+	ROUND4(F4, a, b, c, d, 0, K1,  3);
+	ROUND4(F4, d, a, b, c, 1, K1,  7);
+	ROUND4(F4, c, d, a, b, 2, K1, 11);
+	ROUND4(F4, b, c, d, a, 3, K1, 19);
+	ROUND4(F4, a, b, c, d, 4, K1,  3);
+	ROUND4(F4, d, a, b, c, 5, K1,  7);
+	ROUND4(F4, c, d, a, b, 6, K1, 11);
+	ROUND4(F4, b, c, d, a, 7, K1, 19);
+
+	/* Round 2 */
+	ROUND4(G4, a, b, c, d, 1, K2,  3);
+	ROUND4(G4, d, a, b, c, 3, K2,  5);
+	ROUND4(G4, c, d, a, b, 5, K2,  9);
+	ROUND4(G4, b, c, d, a, 7, K2, 13);
+	ROUND4(G4, a, b, c, d, 0, K2,  3);
+	ROUND4(G4, d, a, b, c, 2, K2,  5);
+	ROUND4(G4, c, d, a, b, 4, K2,  9);
+	ROUND4(G4, b, c, d, a, 6, K2, 13);
+
+	/* Round 3 */
+	ROUND4(H4, a, b, c, d, 3, K3,  3);
+	ROUND4(H4, d, a, b, c, 7, K3,  9);
+	ROUND4(H4, c, d, a, b, 2, K3, 11);
+	ROUND4(H4, b, c, d, a, 6, K3, 15);
+	ROUND4(H4, a, b, c, d, 1, K3,  3);
+	ROUND4(H4, d, a, b, c, 5, K3,  9);
+	ROUND4(H4, c, d, a, b, 0, K3, 11);
+	ROUND4(H4, b, c, d, a, 4, K3, 15);
+
+	_mm_storeu_si128((__m128i *) out,
+			 _mm_add_epi32(b, _mm_set1_epi32(buf[1])));
+}
+
+#undef ROUND4
+#undef F4
+#undef G4
+#undef H4
+#endif
+
+/*
+ * halfMD4Transform() of n inputs with the same key, four at a time if
+ * the CPU has SSE2.
+ */
+static void halfMD4Transforms(__u32 const buf[4], __u32 const in[][8],
+			      __u32 *out, int n)
+{
+	int	i = 0;
+
+#ifdef HALFMD4_SSE2
+	if (cpu_has_sse2) {
+		for (; i + 4 <= n; i += 4)
+			halfMD4Transform4(buf, in + i, out + i);
+	}
+#endif
+	for (; i < n; i++)
+		out[i] = halfMD4Transform(buf, in[i]);
+}
+#endif
+
 #if 0	/* May be needed for IPv6 */
 
 static __u32 twothirdsMD4Transform (__u32 const buf[4], __u32 const in[12])
@@ -1764,6 +2681,78 @@ static __u32 twothirdsMD4Transform (__u32 const buf[4], __u32 const in[12])
 #define REKEY_INTERVAL	300
 #define HASH_BITS 24
 
+#ifdef RANDOM
+/*
+ * Sequence numbers are asked for in batches, so the clock is read, and
+ * the need to rekey is checked, once per batch rather than once per
+ * connection.  Drivers call rand_tcp_rekey() from their own loops, so
+ * a batch should rarely have to pay for picking a new secret.
+ */
+static __u32	tcp_rekey_time = 0;
+static __u32	tcp_count = 0;
+static __u32	tcp_secret[12];
+
+static void tcp_rekey(__u32 now)
+{
+	tcp_rekey_time = now;
+	/* First three words are overwritten for each connection. */
+	get_random_bytes(&tcp_secret[3], sizeof(tcp_secret)-12);
+	tcp_count = (now/REKEY_INTERVAL) << HASH_BITS;
+}
+
+/*
+ * Until the first batch, there's no secret to replace, and picking one
+ * would only take entropy from the pool.
+ */
+void rand_tcp_rekey(void)
+{
+	__u32 now = time(0);
+
+	if (tcp_rekey_time && (now - tcp_rekey_time) > REKEY_INTERVAL)
+		tcp_rekey(now);
+}
+
+#define TCP_CHUNK	16	/* inputs hashed at a time */
+
+int secure_tcp_sequence_numbers(const struct tcp_endpoints *ep,
+				unsigned *seq, int n)
+{
+	struct timespec	ts;
+	__u32		in[TCP_CHUNK][8], hash[TCP_CHUNK], clock;
+	int		i, k, done;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	if (!tcp_rekey_time || (ts.tv_sec - tcp_rekey_time) > REKEY_INTERVAL)
+		tcp_rekey(ts.tv_sec);
+
+	/*
+	 * As close as possible to RFC 793's clock, see
+	 * secure_tcp_sequence_number() below.
+	 */
+	clock = tcp_count + ts.tv_nsec / 1000 + ts.tv_sec * 1000000;
+
+	for (done = 0; done < n; done += k) {
+		k = MIN(n - done, TCP_CHUNK);
+
+		for (i = 0; i < k; i++) {
+			const struct tcp_endpoints *e = &ep[done + i];
+
+			in[i][0] = e->saddr;
+			in[i][1] = e->daddr;
+			in[i][2] = (e->sport << 16) + e->dport;
+			memcpy(&in[i][3], &tcp_secret[3], 5 * sizeof(__u32));
+		}
+		halfMD4Transforms(tcp_secret+8, in, hash, k);
+
+		for (i = 0; i < k; i++)
+			seq[done + i] = (hash[i] & ((1<<HASH_BITS)-1)) + clock;
+	}
+	memset(in, 0, sizeof(in));
+	return n;
+}
+
+#else
 __u32 secure_tcp_sequence_number(__u32 saddr, __u32 daddr,
 				 __u16 sport, __u16 dport)
 {
@@ -1816,8 +2805,9 @@ __u32 secure_tcp_sequence_number(__u32 saddr, __u32 daddr,
 #endif
 	return seq;
 }
+#endif
 
-#ifdef CONFIG_SYN_COOKIES
+#if defined(CONFIG_SYN_COOKIES) || defined(RANDOM)
 /*
  * Secure SYN cookie computation. This is the algorithm worked out by
  * Dan Bernstein and Eric Schenk.
@@ -1916,6 +2906,291 @@ __u32 check_tcp_syn_cookie(__u32 cookie, __u32 saddr, __u32 daddr, __u16 sport,
 	return (cookie - tmp[17]) & COOKIEMASK;	/* Leaving the data behind */
 }
 #endif
+
+#ifdef RANDOM
+/*
+ * Mint or check SYN cookies for a batch of connections.  The minute
+ * counter is taken from the clock once per batch, and the two secrets
+ * are copied into place once per batch, leaving only the endpoint
+ * words and the digest's starting value to be set for each cookie.
+ */
+static void syncookie_prepare(__u32 tmp[2][16 + HASH_BUFFER_SIZE + HASH_EXTRA_SIZE])
+{
+	memcpy(tmp[0]+3, syncookie_secret[0], sizeof(syncookie_secret[0]));
+	memcpy(tmp[1]+3, syncookie_secret[1], sizeof(syncookie_secret[1]));
+}
+
+static __u32 syncookie_hash(__u32 *tmp, int secret,
+			    const struct tcp_endpoints *ep)
+{
+	tmp[0] = ep->saddr;
+	tmp[1] = ep->daddr;
+	tmp[2] = (ep->sport << 16) + ep->dport;
+	memcpy(tmp+16, &syncookie_secret[secret][13], HASH_BUFFER_SIZE*sizeof(__u32));
+	HASH_TRANSFORM(tmp+16, tmp);
+	return tmp[17];
+}
+
+int secure_tcp_syn_cookies(struct tcp_syn_cookie *c, int n)
+{
+	__u32	tmp[2][16 + HASH_BUFFER_SIZE + HASH_EXTRA_SIZE];
+	__u32	count = time(0) / 60;
+	int	i;
+
+	/* as secure_tcp_syn_cookie(), the first cookie picks the secrets */
+	if (syncookie_init == 0) {
+		get_random_bytes(syncookie_secret, sizeof(syncookie_secret));
+		syncookie_init = 1;
+	}
+	syncookie_prepare(tmp);
+	tmp[1][3] = count;	/* minute counter */
+
+	/* as secure_tcp_syn_cookie() */
+	for (i = 0; i < n; i++) {
+		c[i].cookie = syncookie_hash(tmp[0], 0, &c[i].ep) +
+			c[i].sseq + (count << COOKIEBITS) +
+			((syncookie_hash(tmp[1], 1, &c[i].ep) + c[i].data) &
+			 COOKIEMASK);
+	}
+	memset(tmp, 0, sizeof(tmp));
+	return n;
+}
+
+int check_tcp_syn_cookies(struct tcp_syn_cookie *c, int n, unsigned maxdiff)
+{
+	__u32	tmp[2][16 + HASH_BUFFER_SIZE + HASH_EXTRA_SIZE];
+	__u32	count = time(0) / 60;
+	__u32	cookie, diff;
+	int	i;
+
+	/* as check_tcp_syn_cookie(), no secrets means no good cookies */
+	if (syncookie_init == 0) {
+		for (i = 0; i < n; i++)
+			c[i].data = (__u32)-1;
+		return n;
+	}
+	syncookie_prepare(tmp);
+
+	/* as check_tcp_syn_cookie() */
+	for (i = 0; i < n; i++) {
+		cookie = c[i].cookie - syncookie_hash(tmp[0], 0, &c[i].ep) -
+			c[i].sseq;
+
+		diff = (count - (cookie >> COOKIEBITS)) & ((__u32)-1 >> COOKIEBITS);
+		if (diff >= maxdiff) {
+			c[i].data = (__u32)-1;
+			continue;
+		}
+		tmp[1][3] = count - diff;	/* minute counter */
+		c[i].data = (cookie - syncookie_hash(tmp[1], 1, &c[i].ep)) &
+			COOKIEMASK;
+	}
+	memset(tmp, 0, sizeof(tmp));
+	return n;
+}
+
+/*
+ * The batch SYN cookies against the scalar ones, under a known secret
+ * that's swapped in for the test, and checking without a secret.
+ */
+static int selftest_syncookies(void)
+{
+	static __u32			saved[2][16-3+HASH_BUFFER_SIZE];
+	static struct tcp_syn_cookie	c[SELFTEST_COOKIES];
+	int		init = syncookie_init;
+	int		failed = 0;
+	__u32		count;
+	int		i, minted, checked;
+
+	memcpy(saved, syncookie_secret, sizeof(saved));
+
+	for (i = 0; i < SELFTEST_COOKIES; i++) {
+		c[i].ep.saddr = 0x0a000001 + i * 0x9e3779b9;
+		c[i].ep.daddr = 0xc0a80001 ^ i;
+		c[i].ep.sport = 1024 + i * 7;
+		c[i].ep.dport = 80 + i;
+		c[i].sseq = i * 0x01010101;
+		c[i].data = i & 7;
+	}
+
+	syncookie_init = 0;
+	check_tcp_syn_cookies(c, SELFTEST_COOKIES, 4);
+	for (i = 0; i < SELFTEST_COOKIES; i++)
+		if (c[i].data != (__u32)-1)
+			break;
+	failed += selftest_result("syncookie unset",
+				  i == SELFTEST_COOKIES && syncookie_init == 0);
+
+	for (i = 0; i < (int) (sizeof(syncookie_secret) / sizeof(__u32)); i++)
+		((__u32 *) syncookie_secret)[i] = (__u32) i * 0x61c88647U;
+	syncookie_init = 1;
+
+	/* the batches read the clock themselves, so retry over a minute's end */
+	do {
+		count = time(0) / 60;
+
+		for (i = 0; i < SELFTEST_COOKIES; i++)
+			c[i].data = i & 7;
+		secure_tcp_syn_cookies(c, SELFTEST_COOKIES);
+		minted = 1;
+		for (i = 0; i < SELFTEST_COOKIES; i++) {
+			if (c[i].cookie != secure_tcp_syn_cookie(c[i].ep.saddr,
+					c[i].ep.daddr, c[i].ep.sport, c[i].ep.dport,
+					c[i].sseq, count, c[i].data))
+				minted = 0;
+		}
+
+		check_tcp_syn_cookies(c, SELFTEST_COOKIES, 4);
+		checked = 1;
+		for (i = 0; i < SELFTEST_COOKIES; i++) {
+			if (c[i].data != (i & 7) ||
+			    c[i].data != check_tcp_syn_cookie(c[i].cookie,
+					c[i].ep.saddr, c[i].ep.daddr, c[i].ep.sport,
+					c[i].ep.dport, c[i].sseq, count, 4))
+				checked = 0;
+		}
+
+		/* and a forged one */
+		c[0].cookie ^= 0x00012345;
+		check_tcp_syn_cookies(c, 1, 4);
+		if (c[0].data != check_tcp_syn_cookie(c[0].cookie, c[0].ep.saddr,
+				c[0].ep.daddr, c[0].ep.sport, c[0].ep.dport,
+				c[0].sseq, count, 4))
+			checked = 0;
+	} while (count != time(0) / 60);
+
+	failed += selftest_result("syncookie batch", minted);
+	failed += selftest_result("syncookie check", checked);
+
+	memcpy(syncookie_secret, saved, sizeof(saved));
+	memset(saved, 0, sizeof(saved));
+	syncookie_init = init;
+
+	return failed;
+}
+#endif
+
+#ifdef RANDOM
+/*
+ * Time the services the drivers provide besides the pool itself, and
+ * the halfMD4 transform under them, and small urandom reads in each
+ * output mode, and print their throughput.
+ */
+#define BENCH_BATCH	256
+#define BENCH_CALLS	1000
+
+static long bench_ns(struct timespec *start)
+{
+	struct timespec	now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	return (now.tv_sec - start->tv_sec) * 1000000000L +
+		(now.tv_nsec - start->tv_nsec);
+}
+
+static void bench_report(const char *name, int n, long ns)
+{
+	if (ns <= 0)
+		ns = 1;
+	printk("benchmark %-10s %6ld ns/batch of %d, %9.0f/s\n", name,
+	       ns / BENCH_CALLS, n, (double) n * BENCH_CALLS * 1e9 / ns);
+}
+
+void rand_benchmark(void)
+{
+	static struct tcp_endpoints	ep[BENCH_BATCH];
+	static unsigned			seq[BENCH_BATCH];
+	static struct tcp_syn_cookie	syn[BENCH_BATCH];
+	static __u32			in[BENCH_BATCH][8];
+	static __u32 const		key[4] = { 1, 2, 3, 4 };
+	struct timespec			start;
+	int				i, bad, sse2, mode;
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		ep[i].saddr = 0x0a000001;
+		ep[i].daddr = 0x0a000002 + i;
+		ep[i].sport = 1024 + i;
+		ep[i].dport = 80;
+	}
+
+	/* the transform alone, per input, with and without SIMD */
+	for (i = 0; i < BENCH_BATCH; i++) {
+		in[i][0] = ep[i].saddr;
+		in[i][1] = ep[i].daddr;
+		in[i][2] = (ep[i].sport << 16) + ep[i].dport;
+	}
+	sse2 = cpu_has_sse2;
+	cpu_has_sse2 = 0;
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS; i++)
+		halfMD4Transforms(key, in, seq, BENCH_BATCH);
+	bench_report("halfmd4", BENCH_BATCH, bench_ns(&start));
+	cpu_has_sse2 = sse2;
+	if (sse2) {
+		clock_gettime(CLOCK_REALTIME, &start);
+		for (i = 0; i < BENCH_CALLS; i++)
+			halfMD4Transforms(key, in, seq, BENCH_BATCH);
+		bench_report("halfmd4x4", BENCH_BATCH, bench_ns(&start));
+	}
+
+	/* the first batch picks the secret */
+	secure_tcp_sequence_numbers(ep, seq, BENCH_BATCH);
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS; i++)
+		secure_tcp_sequence_numbers(ep, seq, BENCH_BATCH);
+	bench_report("tcpseq", BENCH_BATCH, bench_ns(&start));
+
+	for (i = 0; i < BENCH_BATCH; i++) {
+		syn[i].ep = ep[i];
+		syn[i].sseq = seq[i];
+		syn[i].data = i & 7;	/* an MSS index */
+	}
+	secure_tcp_syn_cookies(syn, BENCH_BATCH);
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS; i++)
+		secure_tcp_syn_cookies(syn, BENCH_BATCH);
+	bench_report("syncookie", BENCH_BATCH, bench_ns(&start));
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS; i++)
+		check_tcp_syn_cookies(syn, BENCH_BATCH, 4);
+	bench_report("syncheck", BENCH_BATCH, bench_ns(&start));
+
+	for (bad = 0, i = 0; i < BENCH_BATCH; i++)
+		bad += syn[i].data != (i & 7);
+	if (bad)
+		printk("benchmark syncheck: %d of %d cookies didn't check\n",
+		       bad, BENCH_BATCH);
+
+	/* 16 byte urandom reads, a batch is one read */
+	mode = output_mode;
+	output_mode = RAND_OUT_EXTRACT;
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS; i++)
+		get_urandom_bytes(in, 16);
+	bench_report("extract16", 1, bench_ns(&start));
+
+	output_mode = RAND_OUT_FKE;
+	get_urandom_bytes(in, 16);	/* the first reseeds */
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS; i++)
+		get_urandom_bytes(in, 16);
+	bench_report("fke16", 1, bench_ns(&start));
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS; i++)
+		get_urandom_bytes(in, 4096);
+	bench_report("fke4096", 1, bench_ns(&start));
+	output_mode = mode;
+
+	clock_gettime(CLOCK_REALTIME, &start);
+	for (i = 0; i < BENCH_CALLS / 10; i++)
+		rand_reseed();
+	bench_report("reseed", 1, bench_ns(&start) * 10);
+	memset(in, 0, sizeof(in));
+}
 #endif
 
 #ifdef RANDOM_BENCHMARK
@@ -1932,12 +3207,21 @@ __u32 check_tcp_syn_cookie(__u32 cookie, __u32 saddr, __u32 daddr, __u16 sport,
  * average time of 8 microseconds.  This should be fast enough so we
  * can use add_timer_randomness() even with the fastest of interrupts...
  */
+#ifdef RANDOM
+static inline unsigned long long get_clock_cnt(void)
+{
+	unsigned high;
+	unsigned low = cycles_read(&high);
+	return (((unsigned long long) high << 32) | low); 
+}
+#else
 static inline unsigned long long get_clock_cnt(void)
 {
 	unsigned long low, high;
 	__asm__(".byte 0x0f,0x31" :"=a" (low), "=d" (high));
 	return (((unsigned long long) high << 32) | low); 
 }
+#endif
 
 __initfunc(static void
 initialize_benchmark(struct random_benchmark *bench,
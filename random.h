@@ -23,8 +23,8 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
-#ifndef __QNX__
-#	error "This is only for using random.c under QNX4 and NTO!"
+#if !defined(__QNX__) && !defined(__linux__)
+#	error "This is only for using random.c under QNX4, NTO, and Linux user space!"
 #endif
 
 /*
@@ -34,8 +34,151 @@
 void rand_initialize(void);
 int rand_initialize_irq(int irq);
 void add_interrupt_randomness(int irq);
+void add_interrupt_sample(int irq, unsigned time, unsigned high);
 void get_random_bytes(void *buf, int nbytes);
+void get_seed_bytes(void *buf, int nbytes);
 int  get_random_size(void);
+int  rand_input_ready(void);
+int  rand_output_ready(void);
+void add_random_bytes(const void *buf, int nbytes, int entropy_bits);
+
+/*
+* Entropy count control, as with Linux's RNDGETENTCNT, RNDADDTOENTCNT,
+* RNDZAPENTCNT and RNDCLEARPOOL ioctls.
+*/
+
+int  rand_get_entcnt(void);
+void rand_add_entcnt(int ent_count);
+void rand_zap_entcnt(void);
+void rand_clear_pool(void);
+
+/*
+* TCP initial sequence numbers, per RFC 1948, for a batch of n
+* connections. The secret is picked again every 5 minutes, call
+* rand_tcp_rekey() periodically to do that outside of a batch.
+*/
+
+struct tcp_endpoints
+{
+	unsigned		saddr;
+	unsigned		daddr;
+	unsigned short	sport;
+	unsigned short	dport;
+};
+
+int  secure_tcp_sequence_numbers(const struct tcp_endpoints *ep,
+		unsigned *seq, int n);
+void rand_tcp_rekey(void);
+
+/*
+* SYN cookies, for a batch of n connections. Minting sets each cookie
+* from its endpoints, sseq (the client's sequence number) and data (a
+* small value, less than 2^24, such as an MSS index). Checking sets data
+* from each cookie, or to (unsigned)-1 if it's more than maxdiff minutes
+* old. A forged cookie yields a data value that must be rejected as out
+* of range by the caller, so keep the range of data small.
+*/
+
+struct tcp_syn_cookie
+{
+	struct tcp_endpoints	ep;
+	unsigned				sseq;
+	unsigned				data;
+	unsigned				cookie;
+};
+
+int  secure_tcp_syn_cookies(struct tcp_syn_cookie *c, int n);
+int  check_tcp_syn_cookies(struct tcp_syn_cookie *c, int n, unsigned maxdiff);
+
+/*
+* Known answer and statistical tests of the pool, returns the number
+* that failed.
+*/
+
+int  rand_selftest(void);
+
+/*
+* Print the throughput of the TCP services.
+*/
+
+void rand_benchmark(void);
+
+/*
+* Entropy estimators, selectable per source with rand_set_estimator().
+*/
+
+#define RAND_EST_DELTA	0	/* 1st, 2nd, and 3rd order time deltas (default) */
+#define RAND_EST_HEALTH	1	/* SP 800-90B repetition and proportion tests */
+#define RAND_EST_NONE	2	/* mix the source, but never credit it */
+#define RAND_EST_MAX	3
+
+int rand_set_estimator(int irq, int estimator);
+
+/*
+* Output modes for unlimited readers (/dev/urandom), selected with
+* rand_set_output(). get_urandom_bytes() gives output in the mode.
+*/
+
+#define RAND_OUT_EXTRACT	0	/* hash the pool per 10 bytes, as Linux (default) */
+#define RAND_OUT_FKE		1	/* a generator keyed from the pool, that erases
+								its key on each request, see random.c */
+#define RAND_OUT_MAX		2
+
+int  rand_set_output(int mode);
+void get_urandom_bytes(void *buf, int nbytes);
+
+/*
+* Reseeding RAND_OUT_FKE's generator from the pool, when there have been
+* RAND_RESEED_SECS since the last, and the pool has RAND_RESEED_BITS of
+* entropy, or RAND_RESEED_MAXSECS whatever the pool has. Until then
+* rand_reseed_starved() is true while it's the entropy that's missing.
+* get_urandom_bytes() does it when due, unless
+* rand_reseed_schedule(1), when the driver does it off the read path
+* with rand_reseed(), or with the pool locked for rand_reseed_extract()
+* and the key for rand_reseed_install(). See random.c.
+*/
+
+#define RAND_RESEED_BITS	128
+#define RAND_RESEED_SECS	60
+#define RAND_RESEED_MAXSECS	600
+#define RAND_SEED_WORDS		8
+
+struct rand_reseed_stats
+{
+	unsigned	count;		/* reseeds since startup */
+	unsigned	last_us;	/* from hashing the pool to installing the key */
+	unsigned	max_us;
+	unsigned	total_us;
+};
+
+int  rand_reseed_due(void);
+int  rand_reseed_starved(void);
+void rand_set_reseed_policy(int min_bits, int secs);
+void rand_reseed_schedule(int on);
+void rand_reseed(void);
+void rand_reseed_extract(unsigned seed[RAND_SEED_WORDS]);
+void rand_reseed_install(const unsigned seed[RAND_SEED_WORDS]);
+void rand_get_reseed_stats(struct rand_reseed_stats *st);
+
+/*
+* More RAND_OUT_FKE generators, for a driver that wants a key per group
+* of readers, such as randd's one per NUMA node. The driver allocates
+* and locks each, and seeds it from the pool as it reseeds the driver's
+* own: rand_reseed_extract() a seed for each, and rand_fke_install() it.
+* get_urandom_bytes_fke() never touches the pool, so it's a bug to read
+* one that's not been seeded.
+*/
+
+#include <time.h>
+
+struct rand_fke
+{
+	unsigned	key[RAND_SEED_WORDS];
+	time_t		seeded;		/* 0 until rand_fke_install() */
+};
+
+void rand_fke_install(struct rand_fke *g, const unsigned seed[RAND_SEED_WORDS]);
+void get_urandom_bytes_fke(struct rand_fke *g, void *buf, int nbytes);
 #include <sys/types.h>
 
 /*
@@ -46,26 +189,31 @@ int  get_random_size(void);
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <time.h>
+#include <unistd.h>
 
-#ifndef __QNXNTO__
+#if defined(__QNX__) && !defined(__QNXNTO__)
 #	define __QNX4__
 #	include <unix.h>
-#	include "rdtsc64.h"
 #endif
 
+#include "cycles.h"
+
 typedef unsigned int __u32;
 typedef   signed int __s32;
 
 typedef unsigned short __u16;
 typedef unsigned short __u8;
 
-#ifndef __QNXNTO__
+#ifdef __QNX4__
 typedef __s32 ssize_t;
 #endif
+#ifdef __QNX__
 typedef __u32 loff_t;
+#endif
 
 #define inline
 #define static
@@ -78,29 +226,23 @@ typedef __u32 loff_t;
 
 #define kmalloc(X, Y) malloc(X)
 
-#ifndef __QNXNTO__
+#define printk printf
+
+#ifdef __QNX4__
 #	define __i386__
 #endif
 
-#ifndef __QNXNTO__
+#ifdef __QNX4__
 #	define rotate_left(I, WORD) _lrotl(WORD, I)
 #endif
 
-#ifdef __i386__
+/* on Linux, these are the daemon's sources, not real irqs */
+#if defined(__i386__) || defined(__linux__)
 #	define NR_IRQS 16
 #else
 #	error "NR_IRQS must be configured for this platform!"
 #endif
 
-static int Jiffies(void)
-{
-	struct timespec ts;
-	clock_gettime(CLOCK_REALTIME, &ts);
-	return ts.tv_nsec;
-}
-
-#define jiffies Jiffies()
-
 #endif /* RANDOM */
 
 #endif
@@ -80,6 +80,35 @@ void rdtsc64( long64 *ptr );
 	parm nomemory [ebx] modify exact nomemory [eax edx];
 
 
+/**
+* CPUID, see cycles.c. The instruction is only available if the ID
+* bit (21) of EFLAGS can be toggled.
+*/
+int has_cpuid( void );
+#pragma aux has_cpuid = \
+	"pushfd" \
+	"pop  eax" \
+	"mov  ecx,eax" \
+	"xor  eax,200000h" \
+	"push eax" \
+	"popfd" \
+	"pushfd" \
+	"pop  eax" \
+	"push ecx" \
+	"popfd" \
+	"xor  eax,ecx" \
+	"shr  eax,21" \
+	"and  eax,1" \
+	parm nomemory [] modify exact nomemory [eax ecx] value [eax];
+
+unsigned long cpuid_eax( unsigned long leaf );
+#pragma aux cpuid_eax = "xor ecx,ecx" "db 0fh,0a2h" \
+	parm nomemory [eax] modify exact nomemory [eax ebx ecx edx] value [eax];
+
+unsigned long cpuid_edx( unsigned long leaf );
+#pragma aux cpuid_edx = "xor ecx,ecx" "db 0fh,0a2h" \
+	parm nomemory [eax] modify exact nomemory [eax ebx ecx edx] value [edx];
+
 // rdtsc32 - Read Time Stamp Counter 32
 // Read only the least significant 32 bits of the 64 bit cycle counter
 // edx contains the most significant 32 bits, but it not returned by this
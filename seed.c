@@ -0,0 +1,165 @@
+/*
+* Seed file support.
+*
+* The pool starts out knowing little more than the time of day, so
+* /dev/random blocks after a boot until enough irqs have arrived. To
+* carry entropy across reboots, a seed is read from a file at startup
+* and mixed into the pool, and a fresh one is written back periodically
+* and when the driver is unloaded.
+*/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "util.h"
+#include "random.h"
+#include "seed.h"
+
+static time_t lastSave;
+
+/*
+* Mix the whole of the seed file into the pool, crediting it with at
+* most credit bits. Returns the number of bytes mixed in, or -1.
+*
+* The seed must be replaced soon, so that a crash won't reuse it, but
+* that costs a full extraction from the pool. It's left to the next
+* SeedTick() so that it doesn't slow down startup.
+*/
+int SeedLoad(const char* path, int credit)
+{
+	char	buf[BUFSIZ];
+	int		total = 0;
+	int		n;
+	int		fd = open(path, O_RDONLY);
+
+	if(fd == -1) {
+		Warn("seed %s not loaded: [%d] %s", path, ERR(errno));
+		return -1;
+	}
+
+	while((n = read(fd, buf, sizeof(buf))) > 0) {
+		int bits = min(credit, n * 8);
+
+		add_random_bytes(buf, n, bits);
+
+		credit -= bits;
+		total += n;
+	}
+	close(fd);
+
+	memset(buf, 0, sizeof(buf));
+
+	lastSave = 0;
+
+	return total;
+}
+
+/*
+* Flush the directory holding path, so a rename in it is on disk. Not
+* every filesystem can sync a directory, and the seed is saved anyway,
+* so it's best effort.
+*/
+static void SyncDir(const char* path)
+{
+	char	dir[PATH_MAX + 1];
+	char*	slash;
+	int		fd;
+
+	strcpy(dir, path);
+
+	slash = strrchr(dir, '/');
+	if(!slash)
+		strcpy(dir, ".");
+	else if(slash == dir)
+		dir[1] = 0;
+	else
+		*slash = 0;
+
+	fd = open(dir, O_RDONLY);
+	if(fd == -1)
+		return;
+
+	fsync(fd);
+	close(fd);
+}
+
+/*
+* Write a fresh seed, atomically replacing the old one. The data is
+* synced before the rename, and the rename after it, or a crash could
+* leave the name pointing at an empty file.
+*/
+int SeedSave(const char* path)
+{
+	char	buf[SEED_BYTES];
+	char	tmp[PATH_MAX + 1];
+	int		fd;
+	int		n;
+
+	lastSave = time(0);
+
+	if(strlen(path) + 4 > PATH_MAX) {
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+	strcpy(tmp, path);
+	strcat(tmp, ".new");
+
+	fd = open(tmp, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
+
+	if(fd == -1) {
+		Warn("seed %s not saved: [%d] %s", tmp, ERR(errno));
+		return -1;
+	}
+
+	// without debiting the pool, so -c's credit survives the first save
+	get_seed_bytes(buf, sizeof(buf));
+
+	n = write(fd, buf, sizeof(buf));
+
+	memset(buf, 0, sizeof(buf));
+
+	if(n != sizeof(buf)) {
+		Warn("seed %s not saved: [%d] %s", tmp, ERR(n == -1 ? errno : EIO));
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	if(fsync(fd) == -1) {
+		Warn("seed %s not saved: [%d] %s", tmp, ERR(errno));
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	if(close(fd) == -1) {
+		Warn("seed %s not saved: [%d] %s", tmp, ERR(errno));
+		unlink(tmp);
+		return -1;
+	}
+	if(rename(tmp, path) == -1) {
+		Warn("seed %s not saved: [%d] %s", path, ERR(errno));
+		unlink(tmp);
+		return -1;
+	}
+	SyncDir(path);
+
+	return 0;
+}
+
+/*
+* Save the seed if SEED_INTERVAL has passed since the last save.
+*/
+void SeedTick(const char* path)
+{
+	if(path && time(0) - lastSave >= SEED_INTERVAL)
+		SeedSave(path);
+}
+
@@ -0,0 +1,16 @@
+/**
+* Seed file support.
+*/
+
+#ifndef SEED_H
+#define SEED_H
+
+#define SEED_BYTES		512	// size of a saved seed
+#define SEED_INTERVAL	600	// seconds between periodic saves
+
+int		SeedLoad(const char* path, int credit);
+int		SeedSave(const char* path);
+void	SeedTick(const char* path);
+
+#endif
+
@@ -3,39 +3,94 @@
 */
 
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <sys/types.h>
-#include <sys/sched.h>
 #include <sys/stat.h>
 
+#ifdef __QNX__
+#include <sys/sched.h>
+#endif
+
+#if defined(__QNXNTO__) || defined(__linux__)
+#include <pthread.h>
+#endif
+
 #ifdef __QNXNTO__
 #include <sys/neutrino.h>
 #include <sys/procmgr.h>
 #endif
 
 #include "util.h"
+#include "cycles.h"
+#include "random.h"
 
 struct Options options =
 	{
 		0,
 		0,
-		1
+		1,
+		RAND_EST_DELTA,
+		0,
+		0,
+		0,
+		LOGL_INFO,
+		0,
+		0,
+		0,
+		RAND_OUT_EXTRACT,
+		RAND_RESEED_BITS,
+		RAND_RESEED_SECS
 	};
 
+static void LogSignal(int signo);
+
 char usage[] =
-	"Usage: %s [-hd] [-i <irq>]\n"
+	"Usage: %s [-hdrtbqf] [-i <irq>] [-e <estimator>] [-s <seedfile> [-c <bits>]]\n"
+	"          [-m <bits>] [-n <secs>] [-v <level>] [-l <logfile>] [-u <socket>]\n"
 	;
 
 char help[] =
 	"  -h   print this helpful message\n"
-	"  -d   debug mode, don't fork into the background\n"
+	"  -d   debug mode, don't fork into the background, and log to\n"
+	"       stderr at level 3 (unless -v says otherwise)\n"
 	"  -i   irq to use for source of entropy (default is 1, the\n"
 	"       PC keyboard)\n"
+	"  -e   entropy estimator for the irq, one of:\n"
+	"         delta   credit from the time deltas between irqs (default)\n"
+	"         health  credit a fixed 2 bits per irq while SP 800-90B\n"
+	"                 repetition and proportion tests pass\n"
+	"         none    mix the irq into the pool, but credit nothing\n"
+	"  -f   fast key erasure output for /dev/urandom, a generator keyed\n"
+	"       from the pool, instead of hashing the whole pool per 10\n"
+	"       bytes\n"
+	"  -m   bits of entropy the pool must have before -f's generator\n"
+	"       reseeds from it (default 128, randd 0), 0 reseeds on time\n"
+	"       alone, and it reseeds after 10 minutes whatever the pool has\n"
+	"  -n   seconds between -f's reseeds (default 60), they're done\n"
+	"       off the read path, by a thread where there are threads\n"
+	"  -r   only timestamp irqs as they arrive, and mix them into the\n"
+	"       pool from a low priority thread (Nto only)\n"
+	"  -t   run the pool's known answer and statistical self tests,\n"
+	"       and exit with the number that failed\n"
+	"  -b   print the throughput of the TCP sequence number and SYN\n"
+	"       cookie services, and exit\n"
+	"  -s   seed file, mixed into the pool at startup, and rewritten\n"
+	"       every 10 minutes and when the driver is unloaded\n"
+	"  -c   bits of entropy to credit the seed file with (default 0),\n"
+	"       only do this if the seed file is kept secret\n"
+	"  -v   log level, 0 errors, 1 warnings, 2 info (default), 3 debug\n"
+	"  -l   log file, the last 256 log lines are appended to it on\n"
+	"       SIGUSR1, and on a fatal error (default is stderr)\n"
+	"  -u   Unix socket to serve on (randd only, default is\n"
+	"       /run/randd.sock)\n"
+	"  -q   serve with io_uring instead of epoll (randd only)\n"
 	"\n"
 	"Unmount /dev/random and /dev/urandom to unload the driver\n"
 	"nicely, it will exit when there are no mounted devices and\n"
@@ -58,14 +113,35 @@ void Usage(FILE* out)
 {
 	fprintf(out, usage, options.arg0);
 }
+/*
+* Daemonize() changes to /, so a path relative to where we were started
+* is made absolute first. The file needn't exist yet.
+*/
+static char* FullPath(char* path)
+{
+	char	cwd[PATH_MAX];
+	char*	full;
+
+	if(path[0] == '/' || !getcwd(cwd, sizeof(cwd)))
+		return path;
+
+	full = (char*) malloc(strlen(cwd) + strlen(path) + 2);
+	if(!full)
+		return path;
+
+	sprintf(full, "%s/%s", cwd, path);
+
+	return full;
+}
 void GetOpts(int argc, char* argv[])
 {
 	int opt;
+	int level = -1;
 
 	options.arg0 = strrchr(argv[0], '/');
 	options.arg0 = options.arg0 ? options.arg0 : argv[0];
 
-	while((opt = getopt(argc, argv, "hdi:")) != -1) {
+	while((opt = getopt(argc, argv, "hdrtbqfi:e:s:c:m:n:v:l:u:")) != -1) {
 		switch(opt) {
 		case 'h':
 			Usage(stdout);
@@ -80,43 +156,325 @@ void GetOpts(int argc, char* argv[])
 			options.irq = atoi(optarg);
 			break;
 
+		case 'e':
+			options.estimator = EstimatorNo(optarg);
+			break;
+
+		case 'r':
+			options.ring = 1;
+			break;
+
+		case 'f':
+			options.output = RAND_OUT_FKE;
+			break;
+
+		case 't':
+			rand_initialize();
+			exit(rand_selftest());
+
+		case 'b':
+			rand_initialize();
+			rand_benchmark();
+			exit(0);
+
+		case 's':
+			options.seed = FullPath(optarg);
+			break;
+
+		case 'c':
+			options.credit = atoi(optarg);
+			break;
+
+		case 'm':
+			options.reseedBits = atoi(optarg);
+			break;
+
+		case 'n':
+			options.reseedSecs = atoi(optarg);
+			break;
+
+		case 'v':
+			level = atoi(optarg);
+			break;
+
+		case 'l':
+			options.logfile = FullPath(optarg);
+			break;
+
+		case 'u':
+			options.socket = FullPath(optarg);
+			break;
+
+		case 'q':
+			options.uring = 1;
+			break;
+
 		default:	
 			Usage(stderr);
 			exit(1);
 		}
 	}
 
+	if(level >= 0)
+		options.loglevel = min(level, LOGL_DEBUG);
+	else if(options.debug)
+		options.loglevel = LOGL_DEBUG;
+
+	signal(SIGUSR1, LogSignal);
+
 	if(options.irq == 0) {
 		Error("A source of randomness must be specified!\n");
 	}
 }
 
 
+int EstimatorNo(const char* name)
+{
+	static const char* names[RAND_EST_MAX] = { "delta", "health", "none" };
+	int i;
+
+	for(i = 0; i < RAND_EST_MAX; i++) {
+		if(strcmp(name, names[i]) == 0)
+			return i;
+	}
+	Error("Unknown entropy estimator '%s'!\n", name);
+	return -1;
+}
+
+void LogCycles()
+{
+	int i;
+
+	if(options.loglevel < LOGL_DEBUG)
+		return;
+
+	cycles_benchmark();
+
+	for(i = 0; i < CYCLES_MAX; i++) {
+		struct cycle_source* s = &cycle_sources[i];
+
+		if(!s->available)
+			continue;
+
+		LogDebug("cycle source %-12s %4u ns/call%s%s", s->name, s->cost,
+			s->invariant ? ", invariant" : "",
+			s == cycle_source ? ", selected" : "");
+	}
+}
+
 /*
-* Error reporting
+* The -f generator's reseeds, at the info level as they're a health
+* check: a count that stops growing means the pool isn't getting the
+* -m bits of entropy. The caller has the key locked, if there's a lock.
 */
+void LogReseeds()
+{
+	struct rand_reseed_stats st;
 
-void Error(const char* format, ...)
+	if(options.output != RAND_OUT_FKE)
+		return;
+
+	rand_get_reseed_stats(&st);
+
+	Log("reseeds %u, last %u us, max %u us, mean %u us", st.count,
+		st.last_us, st.max_us, st.count ? st.total_us / st.count : 0);
+}
+
+/*
+* Warn when -f's reseeds are held back waiting for -m bits of entropy,
+* once when they start to be and once when they catch up.
+*/
+void LogStarved(int starved)
+{
+	static int	warned;
+
+	if(starved && !warned) {
+		Warn("reseeds are waiting for %d bits of entropy", options.reseedBits);
+	}
+	if(!starved && warned) {
+		Log("reseeds have the entropy they need again");
+	}
+
+	warned = starved;
+}
+
+/*
+* Startup timing: the time from the first mark to each phase is
+* logged at the debug level.
+*/
+
+static struct timespec startup;
+
+void StartupMark(const char* phase)
+{
+	struct timespec now;
+	long us;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	if(!startup.tv_sec)
+		startup = now;
+
+	if(options.loglevel < LOGL_DEBUG)
+		return;
+
+	us = (now.tv_sec - startup.tv_sec) * 1000000L
+		+ (now.tv_nsec - startup.tv_nsec) / 1000;
+
+	LogDebug("startup %-8s %8ld us", phase, us);
+}
+
+/*
+* Error reporting and logging
+*
+* Log lines are kept in a ring of the last LOG_LINES lines, tagged with
+* the time, their level, and the number of the request being served.
+* The ring is written out on SIGUSR1, to the -l file or to stderr, and
+* by Error(). In debug mode lines also go to stderr as they're logged.
+*
+* The Log(), Warn(), and Debug() macros check the level before calling
+* in here, so a disabled level costs a branch.
+*
+* devc-random's Mixer logs alongside the resmgr thread, so where there
+* are threads the ring is locked while a line is written or dumped.
+*/
+
+#define LOG_LINES	256
+#define LOG_LINESZ	160
+
+unsigned		logRequest;
+
+static char			logRing[LOG_LINES][LOG_LINESZ];
+static unsigned		logNext;
+static volatile int	logDumpPending;
+
+#if defined(__QNXNTO__) || defined(__linux__)
+static pthread_mutex_t	logMutex = PTHREAD_MUTEX_INITIALIZER;
+
+#define LogLock()	pthread_mutex_lock(&logMutex)
+#define LogUnlock()	pthread_mutex_unlock(&logMutex)
+#else
+#define LogLock()
+#define LogUnlock()
+#endif
+
+static void LogWrite(int level, const char* format, va_list al)
+{
+	char*			line;
+	struct timespec	ts;
+	int				n;
+
+	LogLock();
+
+	line = logRing[logNext++ % LOG_LINES];
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+
+	n = sprintf(line, "%ld.%03ld %c #%u ", (long) ts.tv_sec,
+		ts.tv_nsec / 1000000, "EWID"[level], logRequest);
+
+	vsnprintf(line + n, LOG_LINESZ - n, format, al);
+
+	// the ring holds lines, not newlines
+	n = strlen(line);
+	while(n > 0 && line[n - 1] == '\n')
+		line[--n] = '\0';
+
+	if(options.debug)
+		fprintf(stderr, "%s\n", line);
+
+	LogUnlock();
+}
+void LogDump(FILE* out)
+{
+	unsigned i;
+
+	LogLock();
+
+	i = logNext > LOG_LINES ? logNext - LOG_LINES : 0;
+
+	for(; i < logNext; i++)
+		fprintf(out, "%s\n", logRing[i % LOG_LINES]);
+
+	fflush(out);
+
+	LogUnlock();
+}
+static void LogDumpFile()
+{
+	FILE* out = fopen(options.logfile, "a");
+
+	if(out) {
+		LogDump(out);
+		fclose(out);
+	}
+}
+static void LogSignal(int signo)
+{
+	logDumpPending = signo;
+}
+void LogPoll()
+{
+	if(!logDumpPending)
+		return;
+
+	logDumpPending = 0;
+
+	if(options.logfile)
+		LogDumpFile();
+	else
+		LogDump(stderr);
+}
+void LogError(const char* format, ...)
 {
 	va_list	al;
 	va_start(al, format);
-	vfprintf(stderr, format, al);
+	LogWrite(LOGL_ERROR, format, al);
+	va_end(al);
+}
+void LogWarn(const char* format, ...)
+{
+	va_list	al;
+	va_start(al, format);
+	LogWrite(LOGL_WARN, format, al);
 	va_end(al);
-
-	if(format[strlen(format) - 1] != '\n')
-		fprintf(stderr, "\n");
-
-	exit(1);
 }
-void Log(const char* format, ...)
+void LogInfo(const char* format, ...)
 {
 	va_list	al;
 	va_start(al, format);
-	vfprintf(stderr, format, al);
+	LogWrite(LOGL_INFO, format, al);
+	va_end(al);
+}
+void LogDebug(const char* format, ...)
+{
+	va_list	al;
+	va_start(al, format);
+	LogWrite(LOGL_DEBUG, format, al);
+	va_end(al);
+}
+
+void Error(const char* format, ...)
+{
+	va_list	al;
+	va_start(al, format);
+	LogWrite(LOGL_ERROR, format, al);
 	va_end(al);
 
-	if(format[strlen(format) - 1] != '\n')
-		printf("\n");
+	// in debug mode, LogWrite() already did this
+	if(!options.debug) {
+		va_start(al, format);
+		vfprintf(stderr, format, al);
+		va_end(al);
+
+		if(format[strlen(format) - 1] != '\n')
+			fprintf(stderr, "\n");
+	}
+
+	if(options.logfile)
+		LogDumpFile();
+
+	exit(1);
 }
 
 /*
@@ -126,7 +484,7 @@ void Log(const char* format, ...)
 void Fork()
 {
 	if(!options.debug) {
-#ifndef __QNXNTO__
+#if defined(__QNX__) && !defined(__QNXNTO__)
 		pid_t	child = fork();
 
 		switch(child) {
@@ -164,7 +522,7 @@ void Daemonize()
 {
 	if(!options.debug) {
 
-#ifndef __QNXNTO__
+#if defined(__QNX__) && !defined(__QNXNTO__)
 /*
 	could use this to keep device times up-to-date
 		struct _osinfo osdata;
@@ -181,12 +539,16 @@ void Daemonize()
 		close(0);
 		close(1);
 		close(2);
-#else
+#elif defined(__QNXNTO__)
 	int coid = procmgr_daemon(0, 0);
 	if(coid == -1) {
 		Error("daemon mode failed: [%d] %s", ERR(errno));
 	}
 	ConnectDetach(coid);
+#else
+	if(daemon(0, 0) == -1) {
+		Error("daemon mode failed: [%d] %s", ERR(errno));
+	}
 #endif
 
 	}
@@ -6,12 +6,29 @@
 #define UTIL_H
 
 #include <stdio.h>
+#include <stdlib.h>
+
+// QNX's <stdlib.h> has these, Linux's doesn't
+#ifndef min
+#define min(a, b)	((a) < (b) ? (a) : (b))
+#endif
 
 struct Options
 {
 	char*	arg0;
 	int		debug;
 	int		irq;
+	int		estimator;
+	int		ring;
+	char*	seed;
+	int		credit;
+	int		loglevel;
+	char*	logfile;
+	char*	socket;
+	int		uring;
+	int		output;
+	int		reseedBits;
+	int		reseedSecs;
 };
 
 extern struct Options options;
@@ -19,11 +36,40 @@ extern struct Options options;
 void	Help();
 void	Usage(FILE* out);
 void	GetOpts(int argc, char* argv[]);
+int		EstimatorNo(const char* name);
 void    Error(const char* format, ...);
-void    Log(const char* format, ...);
+void	LogCycles();
+void	LogReseeds();
+void	LogStarved(int starved);
+void	StartupMark(const char* phase);
 
 #define ERR(E)  (E), strerror(E)
 
+/*
+* Logging
+*/
+
+#define LOGL_ERROR	0
+#define LOGL_WARN	1
+#define LOGL_INFO	2
+#define LOGL_DEBUG	3
+
+// the number of the request being served, it tags log lines
+extern unsigned	logRequest;
+
+void	LogError(const char* format, ...);
+void	LogWarn(const char* format, ...);
+void	LogInfo(const char* format, ...);
+void	LogDebug(const char* format, ...);
+void	LogDump(FILE* out);
+void	LogPoll();
+
+// Log at a level only if it's enabled, without even evaluating the
+// arguments otherwise. Use like printf(), Debug("x is %d", x);
+#define Warn	if(options.loglevel < LOGL_WARN) ; else LogWarn
+#define Log		if(options.loglevel < LOGL_INFO) ; else LogInfo
+#define Debug	if(options.loglevel < LOGL_DEBUG) ; else LogDebug
+
 void	Fork();
 void	Daemonize();
 